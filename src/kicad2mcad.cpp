@@ -25,12 +25,25 @@
 #include <wx/cmdline.h>
 #include <wx/log.h>
 #include <wx/string.h>
+#include <wx/filefn.h>
 #include <wx/filename.h>
+#include <fstream>
+#include <map>
 #include <sstream>
 #include <iostream>
 #include <Standard_Failure.hxx>
+#include <Standard_Version.hxx>
 
 #include "kicadpcb.h"
+#include "kicadassembly.h"
+#include "oce_utils.h"
+#include "file_watcher.h"
+#include "pcbcache.h"
+#include "profiler.h"
+
+// version of the converter; this must be changed whenever a change
+// to the converter may produce different output for the same input
+#define KICAD2STEP_VERSION "1.7"
 
 class KICAD2MCAD : public wxAppConsole
 {
@@ -41,6 +54,32 @@ public:
     virtual bool OnCmdLineParsed(wxCmdLineParser& parser);
 
 private:
+    // compose the board and write the output file
+    int exportPCB( KICADPCB& aPCB, const wxString& aOutFile );
+
+    // compose the boards listed in the assembly description m_filename
+    // and write them to a single output file
+    int exportAssembly( const wxString& aOutFile );
+
+    // apply the export options to a board
+    void configureBoard( KICADPCB& aPCB );
+
+    // compute a hash of everything which determines the output file: the
+    // board file, the model files (name, time and size), the options
+    // which affect the output and the versions of the converter and OCE
+    bool getExportHash( KICADPCB& aPCB, uint64_t& aHash );
+
+    // add the board and its model files to the watch list; aNames maps the
+    // normalized names reported by the watcher to the names used by the board
+    void watchFiles( KICADPCB& aPCB, FILE_WATCHER& aWatcher,
+        std::map< std::string, std::string >& aNames );
+
+    // wait for changes to the watched files; aReread is set true if the
+    // board file has changed. Changes made while the previous export was
+    // running are reported immediately.
+    bool waitForChanges( KICADPCB& aPCB, FILE_WATCHER& aWatcher,
+        std::map< std::string, std::string >& aNames, bool& aReread );
+
 #ifdef SUPPORTS_IGES
     bool     m_fmtIGES;
 #endif
@@ -48,6 +87,27 @@ private:
     wxString m_filename;
     double   m_xOrigin;
     double   m_yOrigin;
+    long     m_threads;
+    double   m_tileSize;
+    double   m_simplify;
+    wxString m_region;
+    bool     m_cache;
+    wxString m_cacheDir;
+    bool     m_incremental;
+    bool     m_watch;
+    bool     m_skipUnchanged;
+    bool     m_profile;
+    bool     m_check;
+    bool     m_assembly;
+    bool     m_vias;
+    bool     m_tracks;
+    bool     m_zones;
+    bool     m_pads;
+    bool     m_boardOnly;
+    wxString m_panel;
+    wxString m_pitch;
+    double   m_rails;
+    double   m_tabs;
 };
 
 static const wxCmdLineEntryDesc cmdLineDesc[] =
@@ -64,6 +124,48 @@ static const wxCmdLineEntryDesc cmdLineDesc[] =
             wxCMD_LINE_VAL_DOUBLE, wxCMD_LINE_PARAM_OPTIONAL },
         { wxCMD_LINE_OPTION, "y", NULL, "Y origin of board (pcbnew coordinate system)",
             wxCMD_LINE_VAL_DOUBLE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_OPTION, "t", "threads", "number of worker threads (default: all cores)",
+            wxCMD_LINE_VAL_NUMBER, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_OPTION, NULL, "tile-size", "cut the board holes in tiles of the given size (mm) on separate threads",
+            wxCMD_LINE_VAL_DOUBLE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_OPTION, NULL, "simplify", "merge short board outline segments into lines and arcs within the given tolerance (mm)",
+            wxCMD_LINE_VAL_DOUBLE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_SWITCH, NULL, "vias", "drill the holes of the through vias",
+            wxCMD_LINE_VAL_NONE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_SWITCH, NULL, "tracks", "export the tracks on the outer copper layers",
+            wxCMD_LINE_VAL_NONE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_SWITCH, NULL, "zones", "export the zone fills on the outer copper layers",
+            wxCMD_LINE_VAL_NONE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_SWITCH, NULL, "pads", "export the pad copper on the outer copper layers",
+            wxCMD_LINE_VAL_NONE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_SWITCH, NULL, "board-only", "write only the bare board solid; models and copper are skipped",
+            wxCMD_LINE_VAL_NONE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_OPTION, NULL, "panel", "export a panel of NxM (columns x rows) copies of the board",
+            wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_OPTION, NULL, "pitch", "distance x,y (mm) between the boards of the panel",
+            wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_OPTION, NULL, "rails", "add panel rails of the given width (mm)",
+            wxCMD_LINE_VAL_DOUBLE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_OPTION, NULL, "tabs", "join the panel boards and rails with tabs of the given width (mm)",
+            wxCMD_LINE_VAL_DOUBLE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_OPTION, NULL, "region", "export only the region x0,y0,x1,y1 (pcbnew coordinates) or a named keepout",
+            wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_SWITCH, NULL, "cache", "cache the board data beside the board file",
+            wxCMD_LINE_VAL_NONE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_OPTION, NULL, "cache-dir", "cache the board data in the given directory",
+            wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_SWITCH, NULL, "incremental", "reuse the board solid of the previous export if the outline and drills are unchanged",
+            wxCMD_LINE_VAL_NONE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_SWITCH, NULL, "watch", "keep running and export again whenever the board or a model file changes",
+            wxCMD_LINE_VAL_NONE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_SWITCH, NULL, "skip-unchanged", "do not export if the board, models and options are unchanged since the last export",
+            wxCMD_LINE_VAL_NONE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_SWITCH, NULL, "profile", "report the time spent in each phase of the export",
+            wxCMD_LINE_VAL_NONE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_SWITCH, NULL, "check", "validate the board and model solids before writing the output",
+            wxCMD_LINE_VAL_NONE, wxCMD_LINE_PARAM_OPTIONAL },
+        { wxCMD_LINE_SWITCH, NULL, "assembly", "the input file describes an assembly of several boards",
+            wxCMD_LINE_VAL_NONE, wxCMD_LINE_PARAM_OPTIONAL },
         { wxCMD_LINE_SWITCH, "h", NULL, "display this message",
             wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
         { wxCMD_LINE_NONE }
@@ -81,6 +183,23 @@ bool KICAD2MCAD::OnInit()
     m_overwrite = false;
     m_xOrigin = 0.0;
     m_yOrigin = 0.0;
+    m_threads = 0;
+    m_tileSize = 0.0;
+    m_simplify = 0.0;
+    m_cache = false;
+    m_incremental = false;
+    m_watch = false;
+    m_skipUnchanged = false;
+    m_profile = false;
+    m_check = false;
+    m_assembly = false;
+    m_vias = false;
+    m_tracks = false;
+    m_zones = false;
+    m_pads = false;
+    m_boardOnly = false;
+    m_rails = 0.0;
+    m_tabs = 0.0;
 
     if( !wxAppConsole::OnInit() )
         return false;
@@ -110,6 +229,65 @@ bool KICAD2MCAD::OnCmdLineParsed( wxCmdLineParser& parser )
     parser.Found( "x", &m_xOrigin );
     parser.Found( "y", &m_yOrigin );
 
+    if( parser.Found( "t", &m_threads ) && m_threads < 0 )
+        m_threads = 0;
+
+    if( parser.Found( "tile-size", &m_tileSize ) && m_tileSize < 0.0 )
+        m_tileSize = 0.0;
+
+    if( parser.Found( "simplify", &m_simplify ) && m_simplify < 0.0 )
+        m_simplify = 0.0;
+
+    parser.Found( "region", &m_region );
+
+    if( parser.Found( "cache" ) )
+        m_cache = true;
+
+    if( parser.Found( "cache-dir", &m_cacheDir ) )
+        m_cache = true;
+
+    if( parser.Found( "incremental" ) )
+        m_incremental = true;
+
+    if( parser.Found( "watch" ) )
+        m_watch = true;
+
+    if( parser.Found( "skip-unchanged" ) )
+        m_skipUnchanged = true;
+
+    if( parser.Found( "profile" ) )
+        m_profile = true;
+
+    if( parser.Found( "check" ) )
+        m_check = true;
+
+    if( parser.Found( "assembly" ) )
+        m_assembly = true;
+
+    if( parser.Found( "vias" ) )
+        m_vias = true;
+
+    if( parser.Found( "tracks" ) )
+        m_tracks = true;
+
+    if( parser.Found( "zones" ) )
+        m_zones = true;
+
+    if( parser.Found( "pads" ) )
+        m_pads = true;
+
+    if( parser.Found( "board-only" ) )
+        m_boardOnly = true;
+
+    parser.Found( "panel", &m_panel );
+    parser.Found( "pitch", &m_pitch );
+
+    if( parser.Found( "rails", &m_rails ) && m_rails < 0.0 )
+        m_rails = 0.0;
+
+    if( parser.Found( "tabs", &m_tabs ) && m_tabs < 0.0 )
+        m_tabs = 0.0;
+
     wxString fname;
     parser.Found( "f", &fname );
     m_filename = fname;
@@ -141,38 +319,341 @@ int KICAD2MCAD::OnRun()
 
     wxString outfile = fname.GetFullPath();
 
+    // the pool is shared by all boards and must not be resized while in use
+    PCBMODEL::InitThreadPool( (unsigned) m_threads );
+
+    // the boards of an assembly are always composed and written afresh
+    if( m_assembly )
+        return exportAssembly( outfile );
+
+    fname.SetExt( "brep" );
+    wxString boardfile = fname.GetFullPath();
+    fname.SetExt( "k2mh" );
+    std::string hashfile( fname.GetFullPath().ToUTF8() );
+
+    PROFILER profiler;
     KICADPCB pcb;
-    pcb.SetOrigin( m_xOrigin, m_yOrigin );
+    configureBoard( pcb );
+
+    if( m_incremental )
+        pcb.SetBoardCache( std::string( boardfile.ToUTF8() ) );
+
+    // in watch mode the parsed board, the resolved model paths and the
+    // model documents are retained between exports; the board file is
+    // only parsed again when it has changed
+    if( m_watch )
+        pcb.EnableModelCache();
+
+    if( m_profile )
+        pcb.SetProfiler( &profiler );
+
+    bool reread = true;
+    bool loaded = false;
 
-    if( pcb.ReadFile( m_filename ) )
+    // the watcher is armed before the first export and persists between
+    // exports so that files saved while an export is running are not missed
+    FILE_WATCHER watcher;
+    std::map< std::string, std::string > watched;
+
+    if( m_watch )
+        watchFiles( pcb, watcher, watched );
+
+    while( true )
     {
-        bool res;
+        int ret = 0;
+
+        if( m_profile )
+            profiler.Clear();
+
+        if( reread )
+        {
+            PROFILE_SCOPE timer( m_profile ? &profiler : NULL, "read board" );
+            loaded = pcb.ReadFile( m_filename );
+        }
+
+        if( m_watch && loaded )
+            watchFiles( pcb, watcher, watched );
+
+        uint64_t hash = 0;
+        bool uptodate = false;
+        bool hashed = loaded && m_skipUnchanged && getExportHash( pcb, hash );
 
-        try
+        if( hashed && wxFileName::FileExists( outfile ) )
         {
-            pcb.ComposePCB();
+            // the hash of the last successful export is stored beside the output
+            std::ifstream ifile( hashfile.c_str() );
+            uint64_t lasthash = 0;
+
+            if( ifile >> std::hex >> lasthash && lasthash == hash )
+            {
+                std::ostringstream ostr;
+                ostr << "* '" << outfile.ToUTF8() << "' is up to date\n";
+                wxLogMessage( "%s\n", ostr.str().c_str() );
+                uptodate = true;
+            }
+        }
+
+        if( loaded && !uptodate )
+        {
+            wxString whash = wxString::FromUTF8( hashfile.c_str() );
+
+            if( wxFileName::FileExists( whash ) )
+                wxRemoveFile( whash );
+
+            ret = exportPCB( pcb, outfile );
+
+            if( hashed && 0 == ret )
+            {
+                std::ofstream ofile( hashfile.c_str() );
+                ofile << std::hex << hash << "\n";
+            }
+
+            if( m_profile )
+                wxLogMessage( "%s\n", profiler.Report().c_str() );
+        }
+
+        if( !m_watch )
+            return ret;
+
+        pcb.ReleaseModel();
+        wxLog::FlushActive();
+
+        if( !waitForChanges( pcb, watcher, watched, reread ) )
+            return -1;
+    }
+
+    return 0;
+}
+
+
+void KICAD2MCAD::configureBoard( KICADPCB& aPCB )
+{
+    aPCB.SetOrigin( m_xOrigin, m_yOrigin );
+    aPCB.SetThreadCount( (unsigned) m_threads );
+    aPCB.SetTileSize( m_tileSize );
+    aPCB.SetSimplifyTolerance( m_simplify );
+    aPCB.SetViaHoles( m_vias );
+    aPCB.SetTracks( m_tracks );
+    aPCB.SetZones( m_zones );
+    aPCB.SetPads( m_pads );
+    // the boards of an assembly are always complete
+    aPCB.SetBoardOnly( m_boardOnly && !m_assembly );
+    aPCB.SetPanel( std::string( m_panel.ToUTF8() ), std::string( m_pitch.ToUTF8() ),
+        m_rails, m_tabs );
+    aPCB.SetRegion( std::string( m_region.ToUTF8() ) );
+    aPCB.SetCache( m_cache, std::string( m_cacheDir.ToUTF8() ) );
+    return;
+}
+
+
+int KICAD2MCAD::exportAssembly( const wxString& aOutFile )
+{
+    PROFILER profiler;
+    KICADASSEMBLY assy;
+
+    if( !assy.ReadFile( m_filename ) )
+        return -1;
+
+    assy.SetThreadCount( (unsigned) m_threads );
+
+    for( size_t i = 0; i < assy.GetBoardCount(); ++i )
+    {
+        configureBoard( *assy.GetBoard( i ) );
+
+        if( m_profile )
+            assy.GetBoard( i )->SetProfiler( &profiler );
+    }
+
+    bool res;
+    bool valid = true;
+
+    try
+    {
+        if( !assy.ComposeAssembly() )
+            return -1;
+
+        if( m_check )
+            valid = assy.CheckShapes();
+
+        do
+        {
+            PROFILE_SCOPE timer( m_profile ? &profiler : NULL, "write output" );
 
         #ifdef SUPPORTS_IGES
             if( m_fmtIGES )
-                res = pcb.WriteIGES( outfile, m_overwrite );
+                res = assy.WriteIGES( aOutFile, m_overwrite );
             else
         #endif
-                res = pcb.WriteSTEP( outfile, m_overwrite );
+                res = assy.WriteSTEP( aOutFile, m_overwrite );
+        } while( 0 );
 
-            if( !res )
-                return -1;
-        }
-        catch( Standard_Failure e )
-        {
-            e.Print( std::cerr );
+        if( m_profile )
+            wxLogMessage( "%s\n", profiler.Report().c_str() );
+
+        if( !res || !valid )
+            return -1;
+    }
+    catch( Standard_Failure e )
+    {
+        e.Print( std::cerr );
+        return -1;
+    }
+    catch( ... )
+    {
+        std::cerr << "** (no exception information)\n";
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int KICAD2MCAD::exportPCB( KICADPCB& aPCB, const wxString& aOutFile )
+{
+    bool res;
+    bool valid = true;
+
+    try
+    {
+        aPCB.ComposePCB();
+
+        // invalid shapes are reported but the output is still written
+        // so that it may be inspected; the exit code reports the failure
+        if( m_check )
+            valid = aPCB.CheckShapes();
+
+        PROFILE_SCOPE timer( aPCB.GetProfiler(), "write output" );
+
+    #ifdef SUPPORTS_IGES
+        if( m_fmtIGES )
+            res = aPCB.WriteIGES( aOutFile, m_overwrite );
+        else
+    #endif
+            res = aPCB.WriteSTEP( aOutFile, m_overwrite );
+
+        if( !res || !valid )
             return -1;
+    }
+    catch( Standard_Failure e )
+    {
+        e.Print( std::cerr );
+        return -1;
+    }
+    catch( ... )
+    {
+        std::cerr << "** (no exception information)\n";
+        return -1;
+    }
+
+    return 0;
+}
+
+
+bool KICAD2MCAD::getExportHash( KICADPCB& aPCB, uint64_t& aHash )
+{
+    std::string boardname( m_filename.ToUTF8() );
+    uint64_t hash;
+
+    if( !HashFile( boardname, hash ) )
+        return false;
+
+    std::ostringstream ostr;
+    ostr << KICAD2STEP_VERSION << "\n" << std::hex << OCC_VERSION_HEX << std::dec << "\n";
+    ostr.precision( 17 );
+    ostr << m_xOrigin << "\n" << m_yOrigin << "\n" << m_region.ToUTF8() << "\n";
+    ostr << m_simplify << "\n" << ( m_vias ? "vias" : "-" ) << "\n";
+    ostr << ( m_tracks ? "tracks" : "-" ) << "\n" << ( m_zones ? "zones" : "-" ) << "\n";
+    ostr << ( m_pads ? "pads" : "-" ) << "\n" << ( m_boardOnly ? "board-only" : "-" ) << "\n";
+    ostr << m_panel.ToUTF8() << "\n" << m_pitch.ToUTF8() << "\n" << m_rails << "\n" << m_tabs << "\n";
+
+#ifdef SUPPORTS_IGES
+    ostr << ( m_fmtIGES ? "IGES" : "STEP" ) << "\n";
+#else
+    ostr << "STEP\n";
+#endif
+
+    std::vector< std::string > models;
+    aPCB.GetModelFiles( models );
+
+    for( auto& i : models )
+    {
+        wxString mname = wxString::FromUTF8( i.c_str() );
+        ostr << i << "\n";
+
+        if( wxFileName::FileExists( mname ) )
+        {
+            ostr << (long long) wxFileModificationTime( mname ) << " ";
+            ostr << (long long) wxFileName::GetSize( mname ).GetValue() << "\n";
         }
-        catch( ... )
+        else
         {
-            std::cerr << "** (no exception information)\n";
-            return -1;
+            ostr << "-\n";
         }
     }
 
-    return 0;
+    std::string text = ostr.str();
+    aHash = HashBytes( text.data(), text.size(), hash );
+    return true;
+}
+
+
+void KICAD2MCAD::watchFiles( KICADPCB& aPCB, FILE_WATCHER& aWatcher,
+    std::map< std::string, std::string >& aNames )
+{
+    // the model paths are known once the board is read; the names used
+    // by the model cache are only known after an export
+    std::vector< std::string > files;
+    aPCB.GetModelFiles( files );
+
+    std::vector< std::string > sources;
+    aPCB.GetSourceFiles( sources );
+    files.insert( files.end(), sources.begin(), sources.end() );
+    files.push_back( std::string( m_filename.ToUTF8() ) );
+
+    for( auto& i : files )
+    {
+        if( i.empty() )
+            continue;
+
+        wxFileName fname( wxString::FromUTF8( i.c_str() ) );
+        fname.Normalize();
+        aNames[std::string( fname.GetFullPath().ToUTF8() )] = i;
+        aWatcher.AddFile( i );
+    }
+
+    return;
+}
+
+
+bool KICAD2MCAD::waitForChanges( KICADPCB& aPCB, FILE_WATCHER& aWatcher,
+    std::map< std::string, std::string >& aNames, bool& aReread )
+{
+    // pick up any models which were loaded during the export
+    watchFiles( aPCB, aWatcher, aNames );
+
+    wxFileName board( m_filename );
+    board.Normalize();
+    std::string boardname( board.GetFullPath().ToUTF8() );
+
+    std::ostringstream ostr;
+    ostr << "* watching " << aNames.size() << " files for changes\n";
+    wxLogMessage( "%s\n", ostr.str().c_str() );
+    wxLog::FlushActive();
+
+    std::vector< std::string > changed;
+
+    if( !aWatcher.Wait( changed ) )
+        return false;
+
+    aReread = false;
+
+    for( auto& i : changed )
+    {
+        if( i == boardname )
+            aReread = true;
+        else
+            aPCB.ModelChanged( aNames[i] );
+    }
+
+    return true;
 }
@@ -129,7 +129,11 @@ bool S3D_FILENAME_RESOLVER::SetProjectDir( const wxString& aProjDir, bool* flgCh
         return false;
 
     m_curProjDir = projdir.GetPath();
-    wxSetEnv( "KIPRJMOD", m_curProjDir );
+
+    // KIPRJMOD is expanded by each resolver rather than set in the process
+    // environment since the boards of an assembly may be in different
+    // directories and are read concurrently
+    m_EnvVars[ "KIPRJMOD" ] = m_curProjDir;
 
     if( flgChanged )
         *flgChanged = false;
@@ -214,7 +218,8 @@ bool S3D_FILENAME_RESOLVER::createPathList( void )
         // filter out URLs, template directories, and known system paths
         if( mS->first == wxString( "KICAD_PTEMPLATES" )
             || mS->first == wxString( "KIGITHUB" )
-            || mS->first == wxString( "KISYSMOD" ) )
+            || mS->first == wxString( "KISYSMOD" )
+            || mS->first == wxString( "KIPRJMOD" ) )
         {
             ++mS;
             continue;
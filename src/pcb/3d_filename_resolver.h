@@ -58,7 +58,7 @@ private:
     std::map< wxString, wxString, S3D::rsort_wxString > m_NameMap;
     int m_errflags;
     wxString m_curProjDir;
-    // environment variables
+    // environment variables; includes KIPRJMOD once the project directory is set
     std::map< wxString, wxString > m_EnvVars;
 
     /**
@@ -165,6 +165,44 @@ bool Get2DCoordinate( SEXPR::SEXPR* data, DOUBLET& aCoordinate )
 }
 
 
+bool Get2DCoordinate( SEXPR::SEXPR* data, NMPOINT& aCoordinate )
+{
+    // form: (at X Y {rot}); the values are taken from the file text
+    // without passing through a floating point representation
+    int nchild = data->GetNumberOfChildren();
+
+    if( nchild < 3 )
+    {
+        std::ostringstream ostr;
+        ostr << bad_position;
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    int64_t val[2];
+
+    for( int i = 1; i < 3; ++i )
+    {
+        SEXPR::SEXPR* child = data->GetChild( i );
+
+        if( !child->IsDouble() && !child->IsInteger() )
+        {
+            std::ostringstream ostr;
+            ostr << bad_position;
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+            return false;
+        }
+
+        val[i - 1] = child->GetMillionths();
+    }
+
+    aCoordinate.x = val[0];
+    aCoordinate.y = val[1];
+
+    return true;
+}
+
+
 bool Get3DCoordinate( SEXPR::SEXPR* data, TRIPLET& aCoordinate )
 {
     // form: (at X Y Z)
@@ -242,3 +280,18 @@ bool GetXYZRotation( SEXPR::SEXPR* data, TRIPLET& aRotation )
 
     return true;
 }
+
+
+uint64_t HashBytes( const void* aData, size_t aSize, uint64_t aSeed )
+{
+    const unsigned char* dp = (const unsigned char*) aData;
+    uint64_t hash = aSeed;
+
+    for( size_t i = 0; i < aSize; ++i )
+    {
+        hash ^= dp[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
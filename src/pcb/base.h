@@ -30,6 +30,10 @@
 #ifndef KICADBASE_H
 #define KICADBASE_H
 
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
 namespace SEXPR
 {
     class SEXPR;
@@ -81,9 +85,150 @@ struct TRIPLET
     TRIPLET( double aX, double aY, double aZ ) : x( aX ), y( aY ), z( aZ ) { return; }
 };
 
+// axis aligned 2D bounding box; a default constructed box is empty
+struct BOX2D
+{
+    double minx;
+    double miny;
+    double maxx;
+    double maxy;
+
+    BOX2D() : minx( 1.0e30 ), miny( 1.0e30 ), maxx( -1.0e30 ), maxy( -1.0e30 ) { return; }
+
+    BOX2D( double aX0, double aY0, double aX1, double aY1 )
+    {
+        minx = aX0 < aX1 ? aX0 : aX1;
+        maxx = aX0 < aX1 ? aX1 : aX0;
+        miny = aY0 < aY1 ? aY0 : aY1;
+        maxy = aY0 < aY1 ? aY1 : aY0;
+    }
+
+    bool IsEmpty() const
+    {
+        return minx > maxx || miny > maxy;
+    }
+
+    void Add( double aX, double aY )
+    {
+        if( aX < minx )
+            minx = aX;
+
+        if( aX > maxx )
+            maxx = aX;
+
+        if( aY < miny )
+            miny = aY;
+
+        if( aY > maxy )
+            maxy = aY;
+    }
+
+    void Add( const BOX2D& aBox )
+    {
+        if( aBox.IsEmpty() )
+            return;
+
+        Add( aBox.minx, aBox.miny );
+        Add( aBox.maxx, aBox.maxy );
+    }
+
+    void Inflate( double aDistance )
+    {
+        if( IsEmpty() )
+            return;
+
+        minx -= aDistance;
+        miny -= aDistance;
+        maxx += aDistance;
+        maxy += aDistance;
+    }
+
+    bool Intersects( const BOX2D& aBox ) const
+    {
+        return !( aBox.minx > maxx || aBox.maxx < minx
+                  || aBox.miny > maxy || aBox.maxy < miny );
+    }
+
+    bool Contains( const BOX2D& aBox ) const
+    {
+        return aBox.minx >= minx && aBox.maxx <= maxx
+               && aBox.miny >= miny && aBox.maxy <= maxy;
+    }
+};
+
+/*
+ * Board coordinates in integer nanometers. KiCad stores board data in
+ * nanometers and the values are parsed exactly from the file text so
+ * that board level points can be compared and hashed exactly; the
+ * floating point DOUBLET representation is used for calculations and
+ * for the construction of the OCC geometry.
+ */
+struct NMPOINT
+{
+    int64_t x;
+    int64_t y;
+
+    NMPOINT() : x( 0 ), y( 0 ) { return; }
+    NMPOINT( int64_t aX, int64_t aY ) : x( aX ), y( aY ) { return; }
+
+    bool operator==( const NMPOINT& aPoint ) const
+    {
+        return x == aPoint.x && y == aPoint.y;
+    }
+
+    bool operator!=( const NMPOINT& aPoint ) const
+    {
+        return x != aPoint.x || y != aPoint.y;
+    }
+
+    bool operator<( const NMPOINT& aPoint ) const
+    {
+        return x < aPoint.x || ( x == aPoint.x && y < aPoint.y );
+    }
+};
+
+// conversions between millimeters and nanometers
+inline int64_t MMToNM( double aValue )
+{
+    return (int64_t) std::llround( aValue * 1.0e6 );
+}
+
+inline double NMToMM( int64_t aValue )
+{
+    return (double) aValue * 1.0e-6;
+}
+
+inline NMPOINT ToNM( const DOUBLET& aPoint )
+{
+    return NMPOINT( MMToNM( aPoint.x ), MMToNM( aPoint.y ) );
+}
+
+inline DOUBLET ToMM( const NMPOINT& aPoint )
+{
+    return DOUBLET( NMToMM( aPoint.x ), NMToMM( aPoint.y ) );
+}
+
 bool Get2DPositionAndRotation( SEXPR::SEXPR* data, DOUBLET& aPosition, double& aRotation );
 bool Get2DCoordinate( SEXPR::SEXPR* data, DOUBLET& aCoordinate );
+bool Get2DCoordinate( SEXPR::SEXPR* data, NMPOINT& aCoordinate );
 bool Get3DCoordinate( SEXPR::SEXPR* data, TRIPLET& aCoordinate );
 bool GetXYZRotation( SEXPR::SEXPR* data, TRIPLET& aRotation );
 
+// initial value for the hash functions below
+#define HASH_SEED ( 0xcbf29ce484222325ULL )
+
+// 64-bit FNV-1a hash of a block of data; aSeed may be the result of a
+// previous call so that several items can be hashed in sequence
+uint64_t HashBytes( const void* aData, size_t aSize, uint64_t aSeed = HASH_SEED );
+
+// hash functor for using exact nanometer points as keys in unordered containers
+struct NMPOINT_HASH
+{
+    size_t operator()( const NMPOINT& aPoint ) const
+    {
+        return (size_t) HashBytes( &aPoint.y, sizeof( aPoint.y ),
+            HashBytes( &aPoint.x, sizeof( aPoint.x ) ) );
+    }
+};
+
 #endif  // KICADBASE_H
@@ -0,0 +1,227 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <wx/log.h>
+#include <wx/utils.h>
+#include <sstream>
+
+#include "file_watcher.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+// period (ms) without further changes after which a burst of changes is complete
+#define SETTLE_TIME ( 250 )
+
+
+FILE_WATCHER::FILE_WATCHER()
+{
+#ifdef __linux__
+    m_fd = inotify_init1( IN_CLOEXEC );
+
+    if( m_fd < 0 )
+    {
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+        ostr << "  * could not initialize inotify (errno " << errno << ")\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+    }
+#endif
+
+    return;
+}
+
+
+FILE_WATCHER::~FILE_WATCHER()
+{
+#ifdef __linux__
+    if( m_fd >= 0 )
+        close( m_fd );
+#endif
+
+    return;
+}
+
+
+bool FILE_WATCHER::AddFile( const std::string& aFileName )
+{
+    wxFileName fname( wxString::FromUTF8( aFileName.c_str() ) );
+    fname.Normalize();
+    std::string name( fname.GetFullPath().ToUTF8() );
+
+    if( !m_files.insert( name ).second )
+        return true;
+
+#ifdef __linux__
+    if( m_fd < 0 )
+        return false;
+
+    std::string dir( fname.GetPath().ToUTF8() );
+
+    for( auto& i : m_dirs )
+    {
+        if( i.second == dir )
+            return true;
+    }
+
+    int wd = inotify_add_watch( m_fd, dir.c_str(),
+        IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE );
+
+    if( wd < 0 )
+    {
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+        ostr << "  * could not watch directory '" << dir << "' (errno " << errno << ")\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    m_dirs[wd] = dir;
+#else
+    getStamp( name, m_stamps[name] );
+#endif
+
+    return true;
+}
+
+
+bool FILE_WATCHER::Wait( std::vector< std::string >& aChanged )
+{
+    aChanged.clear();
+
+    if( m_files.empty() )
+        return false;
+
+    std::set< std::string > changed;
+
+#ifdef __linux__
+    if( m_fd < 0 )
+        return false;
+
+    // block until a watched file changes, then collect the rest of the burst
+    while( changed.empty() )
+    {
+        if( !readEvents( -1, changed ) )
+            return false;
+    }
+
+    while( readEvents( SETTLE_TIME, changed ) );
+#else
+    bool settled = false;
+
+    while( !settled )
+    {
+        wxMilliSleep( SETTLE_TIME );
+        bool found = false;
+
+        for( auto& i : m_stamps )
+        {
+            std::pair< long long, long long > stamp;
+            getStamp( i.first, stamp );
+
+            if( stamp != i.second )
+            {
+                i.second = stamp;
+                changed.insert( i.first );
+                found = true;
+            }
+        }
+
+        settled = !changed.empty() && !found;
+    }
+#endif
+
+    aChanged.assign( changed.begin(), changed.end() );
+    return true;
+}
+
+
+#ifdef __linux__
+bool FILE_WATCHER::readEvents( int aTimeout, std::set< std::string >& aChanged )
+{
+    struct pollfd pfd;
+    pfd.fd = m_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int nr = poll( &pfd, 1, aTimeout );
+
+    if( nr < 0 && EINTR == errno )
+        return true;
+
+    if( nr <= 0 )
+        return false;
+
+    alignas( struct inotify_event ) char buf[ 16 * ( sizeof( struct inotify_event ) + NAME_MAX + 1 ) ];
+    ssize_t len = read( m_fd, buf, sizeof( buf ) );
+
+    if( len <= 0 )
+        return false;
+
+    for( char* ptr = buf; ptr < buf + len; )
+    {
+        const struct inotify_event* event = (const struct inotify_event*) ptr;
+        ptr += sizeof( struct inotify_event ) + event->len;
+
+        if( 0 == event->len )
+            continue;
+
+        std::map< int, std::string >::const_iterator dir = m_dirs.find( event->wd );
+
+        if( dir == m_dirs.end() )
+            continue;
+
+        wxFileName fname( wxString::FromUTF8( dir->second.c_str() ),
+            wxString::FromUTF8( event->name ) );
+        std::string name( fname.GetFullPath().ToUTF8() );
+
+        if( m_files.count( name ) )
+            aChanged.insert( name );
+    }
+
+    return true;
+}
+#else
+void FILE_WATCHER::getStamp( const std::string& aFileName, std::pair< long long, long long >& aStamp )
+{
+    wxString fname = wxString::FromUTF8( aFileName.c_str() );
+
+    if( !wxFileName::FileExists( fname ) )
+    {
+        aStamp = std::make_pair( -1LL, -1LL );
+        return;
+    }
+
+    aStamp.first = (long long) wxFileModificationTime( fname );
+    aStamp.second = (long long) wxFileName::GetSize( fname ).GetValue();
+    return;
+}
+#endif
@@ -0,0 +1,74 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+/**
+ * @file file_watcher.h
+ * declares an object which waits for changes to a set of files;
+ * on Linux the changes are reported by inotify, otherwise the
+ * modification time and size of the files are polled.
+ */
+
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+
+class FILE_WATCHER
+{
+private:
+    std::set< std::string > m_files;    // normalized names of the watched files
+
+#ifdef __linux__
+    int                             m_fd;       // inotify instance
+    std::map< int, std::string >    m_dirs;     // watch descriptors to directory names
+
+    // read pending events and add the names of changed files to aChanged;
+    // returns false if no events were pending within aTimeout (ms)
+    bool readEvents( int aTimeout, std::set< std::string >& aChanged );
+#else
+    // modification time and size of each file at the last check
+    std::map< std::string, std::pair< long long, long long > > m_stamps;
+
+    void getStamp( const std::string& aFileName, std::pair< long long, long long >& aStamp );
+#endif
+
+public:
+    FILE_WATCHER();
+    virtual ~FILE_WATCHER();
+
+    // add a file to the watch list; the containing directory is watched
+    // so that files which are replaced rather than rewritten are detected
+    bool AddFile( const std::string& aFileName );
+
+    // block until one or more watched files have changed and return their
+    // names; bursts of changes (as produced by editors which save a file
+    // in several steps) are collected into a single result
+    bool Wait( std::vector< std::string >& aChanged );
+};
+
+#endif  // FILE_WATCHER_H
@@ -0,0 +1,992 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include "geom2d.h"
+#include "rtree.h"
+
+// minimum number of chords in a full circle
+#define MIN_CIRCLE_SEGMENTS ( 8 )
+// distance (mm) below which edges are considered to touch
+#define CONTACT_DIST ( 1.0e-5 )
+// distance (mm) within which points and edges coincide in the polygon union
+#define UNION_EPS ( 1.0e-6 )
+
+
+double PointDistance2( const DOUBLET& aPoint, const DOUBLET& aS0, const DOUBLET& aS1 )
+{
+    double dx = aS1.x - aS0.x;
+    double dy = aS1.y - aS0.y;
+    double len2 = dx * dx + dy * dy;
+    double t = 0.0;
+
+    if( len2 > 0.0 )
+    {
+        t = ( ( aPoint.x - aS0.x ) * dx + ( aPoint.y - aS0.y ) * dy ) / len2;
+        t = std::max( 0.0, std::min( 1.0, t ) );
+    }
+
+    double px = aS0.x + t * dx - aPoint.x;
+    double py = aS0.y + t * dy - aPoint.y;
+
+    return px * px + py * py;
+}
+
+
+// orientation of the point aC with respect to the line aA-aB
+static double cross( const DOUBLET& aA, const DOUBLET& aB, const DOUBLET& aC )
+{
+    return ( aB.x - aA.x ) * ( aC.y - aA.y ) - ( aB.y - aA.y ) * ( aC.x - aA.x );
+}
+
+
+double SegmentDistance2( const DOUBLET& aA0, const DOUBLET& aA1,
+    const DOUBLET& aB0, const DOUBLET& aB1 )
+{
+    double d0 = cross( aA0, aA1, aB0 );
+    double d1 = cross( aA0, aA1, aB1 );
+    double d2 = cross( aB0, aB1, aA0 );
+    double d3 = cross( aB0, aB1, aA1 );
+
+    // proper intersection; collinear and touching cases are
+    // handled by the point to segment distances below
+    if( ( ( d0 > 0.0 && d1 < 0.0 ) || ( d0 < 0.0 && d1 > 0.0 ) )
+        && ( ( d2 > 0.0 && d3 < 0.0 ) || ( d2 < 0.0 && d3 > 0.0 ) ) )
+        return 0.0;
+
+    double d = PointDistance2( aA0, aB0, aB1 );
+    d = std::min( d, PointDistance2( aA1, aB0, aB1 ) );
+    d = std::min( d, PointDistance2( aB0, aA0, aA1 ) );
+    d = std::min( d, PointDistance2( aB1, aA0, aA1 ) );
+
+    return d;
+}
+
+
+double PolygonArea( const std::vector< DOUBLET >& aPolygon )
+{
+    size_t np = aPolygon.size();
+    double area = 0.0;
+
+    for( size_t i = 0, j = np - 1; i < np; j = i++ )
+        area += ( aPolygon[j].x - aPolygon[i].x ) * ( aPolygon[j].y + aPolygon[i].y );
+
+    return 0.5 * area;
+}
+
+
+bool PointInPolygon( const DOUBLET& aPoint, const std::vector< DOUBLET >& aPolygon )
+{
+    size_t np = aPolygon.size();
+    bool inside = false;
+
+    for( size_t i = 0, j = np - 1; i < np; j = i++ )
+    {
+        const DOUBLET& p0 = aPolygon[j];
+        const DOUBLET& p1 = aPolygon[i];
+
+        if( ( p1.y > aPoint.y ) != ( p0.y > aPoint.y )
+            && aPoint.x < ( p0.x - p1.x ) * ( aPoint.y - p1.y ) / ( p0.y - p1.y ) + p1.x )
+            inside = !inside;
+    }
+
+    return inside;
+}
+
+
+bool CircleCenter( const DOUBLET& aP0, const DOUBLET& aP1, const DOUBLET& aP2, DOUBLET& aCenter )
+{
+    double bx = aP1.x - aP0.x;
+    double by = aP1.y - aP0.y;
+    double cx = aP2.x - aP0.x;
+    double cy = aP2.y - aP0.y;
+    double d = 2.0 * ( bx * cy - by * cx );
+
+    // the points are collinear or coincident
+    if( std::fabs( d ) < 1.0e-12 )
+        return false;
+
+    double b2 = bx * bx + by * by;
+    double c2 = cx * cx + cy * cy;
+
+    aCenter.x = aP0.x + ( cy * b2 - by * c2 ) / d;
+    aCenter.y = aP0.y + ( bx * c2 - cx * b2 ) / d;
+
+    return true;
+}
+
+
+int ArcSegments( double aRadius, double aAngle, double aDeviation )
+{
+    aAngle = std::fabs( aAngle );
+
+    if( aRadius <= aDeviation )
+        return std::max( 1, (int) std::ceil( aAngle / M_PI_2 ) );
+
+    // angle subtended by a chord with the given deviation
+    double step = 2.0 * std::acos( 1.0 - aDeviation / aRadius );
+    int n = (int) std::ceil( aAngle / step );
+    int nmin = (int) std::ceil( MIN_CIRCLE_SEGMENTS * aAngle / ( 2.0 * M_PI ) );
+
+    return std::max( std::max( n, nmin ), 1 );
+}
+
+
+namespace
+{
+    struct SWEEP_EDGE
+    {
+        DOUBLET p;          // left end point
+        DOUBLET q;          // right end point
+        size_t  polygon;
+        size_t  index;      // index of the edge in its polygon
+        bool    forward;    // set true if the polygon runs from p to q
+    };
+
+    struct SWEEP_EVENT
+    {
+        DOUBLET point;
+        size_t  edge;
+        bool    left;       // set true for the left end point of the edge
+
+        bool operator<( const SWEEP_EVENT& aEvent ) const
+        {
+            if( point.x != aEvent.point.x )
+                return point.x < aEvent.point.x;
+
+            if( point.y != aEvent.point.y )
+                return point.y < aEvent.point.y;
+
+            // edges are inserted before edges are removed at the same point
+            // so that edges which meet at an end point are compared
+            if( left != aEvent.left )
+                return left;
+
+            return edge < aEvent.edge;
+        }
+    };
+
+    // orders the active edges from bottom to top at the current sweep position
+    struct SWEEP_ORDER
+    {
+        const std::vector< SWEEP_EDGE >* edges;
+        const double* sweepX;
+
+        double yAt( const SWEEP_EDGE& aEdge ) const
+        {
+            if( aEdge.q.x == aEdge.p.x )
+                return aEdge.p.y;
+
+            double t = ( *sweepX - aEdge.p.x ) / ( aEdge.q.x - aEdge.p.x );
+            t = std::max( 0.0, std::min( 1.0, t ) );
+
+            return aEdge.p.y + t * ( aEdge.q.y - aEdge.p.y );
+        }
+
+        bool operator()( size_t aA, size_t aB ) const
+        {
+            if( aA == aB )
+                return false;
+
+            const SWEEP_EDGE& ea = ( *edges )[aA];
+            const SWEEP_EDGE& eb = ( *edges )[aB];
+            double ya = yAt( ea );
+            double yb = yAt( eb );
+
+            if( ya != yb )
+                return ya < yb;
+
+            // edges which meet at the sweep line are ordered by slope
+            double sa = ( ea.q.y - ea.p.y ) * ( eb.q.x - eb.p.x );
+            double sb = ( eb.q.y - eb.p.y ) * ( ea.q.x - ea.p.x );
+
+            if( sa != sb )
+                return sa < sb;
+
+            return aA < aB;
+        }
+    };
+}
+
+
+// closest pair of points of two segments which are known to meet
+static DOUBLET contactPoint( const SWEEP_EDGE& aA, const SWEEP_EDGE& aB )
+{
+    double dax = aA.q.x - aA.p.x;
+    double day = aA.q.y - aA.p.y;
+    double dbx = aB.q.x - aB.p.x;
+    double dby = aB.q.y - aB.p.y;
+    double den = dax * dby - day * dbx;
+
+    if( den != 0.0 )
+    {
+        double t = ( ( aB.p.x - aA.p.x ) * dby - ( aB.p.y - aA.p.y ) * dbx ) / den;
+
+        if( t >= 0.0 && t <= 1.0 )
+            return DOUBLET( aA.p.x + t * dax, aA.p.y + t * day );
+    }
+
+    // the segments touch at an end point or are collinear
+    const DOUBLET* ends[4] = { &aA.p, &aA.q, &aB.p, &aB.q };
+    double best = PointDistance2( aA.p, aB.p, aB.q );
+    size_t idx = 0;
+
+    for( size_t i = 1; i < 4; ++i )
+    {
+        double d = i < 2 ? PointDistance2( *ends[i], aB.p, aB.q )
+                         : PointDistance2( *ends[i], aA.p, aA.q );
+
+        if( d < best )
+        {
+            best = d;
+            idx = i;
+        }
+    }
+
+    return *ends[idx];
+}
+
+
+bool FindPolygonContact( const std::vector< std::vector< DOUBLET > >& aPolygons,
+    POLYGON_CONTACT& aContact, std::vector< int >& aParent )
+{
+    std::vector< SWEEP_EDGE > edges;
+    std::vector< SWEEP_EVENT > events;
+    std::vector< size_t > sizes( aPolygons.size(), 0 );
+    std::vector< char > ccw( aPolygons.size(), false );
+
+    aParent.assign( aPolygons.size(), -1 );
+
+    for( size_t i = 0; i < aPolygons.size(); ++i )
+    {
+        const std::vector< DOUBLET >& poly = aPolygons[i];
+        sizes[i] = poly.size();
+        ccw[i] = PolygonArea( poly ) > 0.0;
+
+        for( size_t j = 0; j < poly.size(); ++j )
+        {
+            const DOUBLET& p0 = poly[j];
+            const DOUBLET& p1 = poly[( j + 1 ) % poly.size()];
+            SWEEP_EDGE edge;
+            edge.polygon = i;
+            edge.index = j;
+            edge.forward = p0.x < p1.x || ( p0.x == p1.x && p0.y < p1.y );
+            edge.p = edge.forward ? p0 : p1;
+            edge.q = edge.forward ? p1 : p0;
+
+            SWEEP_EVENT ev;
+            ev.edge = edges.size();
+            ev.point = edge.p;
+            ev.left = true;
+            events.push_back( ev );
+            ev.point = edge.q;
+            ev.left = false;
+            events.push_back( ev );
+
+            edges.push_back( edge );
+        }
+    }
+
+    std::sort( events.begin(), events.end() );
+
+    // test whether two edges meet other than at a shared vertex
+    auto meet = [&]( size_t aA, size_t aB ) -> bool
+    {
+        const SWEEP_EDGE& ea = edges[aA];
+        const SWEEP_EDGE& eb = edges[aB];
+        const double lim2 = CONTACT_DIST * CONTACT_DIST;
+
+        if( ea.polygon == eb.polygon )
+        {
+            size_t n = sizes[ea.polygon];
+            size_t d = ea.index > eb.index ? ea.index - eb.index : eb.index - ea.index;
+
+            if( d == 1 || d == n - 1 )
+            {
+                // adjacent edges meet at their common vertex; they are only
+                // at fault if one doubles back along the other
+                const DOUBLET& sa = ( ea.p.x == eb.p.x && ea.p.y == eb.p.y )
+                                    || ( ea.p.x == eb.q.x && ea.p.y == eb.q.y ) ? ea.q : ea.p;
+                const DOUBLET& sb = ( eb.p.x == ea.p.x && eb.p.y == ea.p.y )
+                                    || ( eb.p.x == ea.q.x && eb.p.y == ea.q.y ) ? eb.q : eb.p;
+
+                return PointDistance2( sa, eb.p, eb.q ) < lim2
+                       || PointDistance2( sb, ea.p, ea.q ) < lim2;
+            }
+        }
+
+        return SegmentDistance2( ea.p, ea.q, eb.p, eb.q ) < lim2;
+    };
+
+    auto report = [&]( size_t aA, size_t aB ) -> bool
+    {
+        aContact.m_polygon0 = edges[aA].polygon;
+        aContact.m_polygon1 = edges[aB].polygon;
+        aContact.m_point = contactPoint( edges[aA], edges[aB] );
+        return true;
+    };
+
+    double sweepX = 0.0;
+    SWEEP_ORDER order;
+    order.edges = &edges;
+    order.sweepX = &sweepX;
+
+    std::set< size_t, SWEEP_ORDER > status( order );
+    std::vector< std::set< size_t, SWEEP_ORDER >::iterator > pos( edges.size(), status.end() );
+    std::vector< char > seen( aPolygons.size(), false );
+
+    for( const auto& ev : events )
+    {
+        sweepX = ev.point.x;
+
+        if( ev.left )
+        {
+            auto it = status.insert( ev.edge ).first;
+            pos[ev.edge] = it;
+
+            if( it != status.begin() && meet( *std::prev( it ), ev.edge ) )
+                return report( *std::prev( it ), ev.edge );
+
+            if( std::next( it ) != status.end() && meet( *std::next( it ), ev.edge ) )
+                return report( *std::next( it ), ev.edge );
+
+            size_t poly = edges[ev.edge].polygon;
+
+            if( !seen[poly] )
+            {
+                // the first edge of a polygon starts at its leftmost vertex; the
+                // nearest edge of another polygon below it determines the nesting
+                seen[poly] = true;
+                auto below = it;
+
+                while( below != status.begin() )
+                {
+                    --below;
+                    const SWEEP_EDGE& edge = edges[*below];
+
+                    if( edge.polygon == poly )
+                        continue;
+
+                    // the interior of a counterclockwise polygon lies to the
+                    // left of its edges, i.e. above edges which run forward
+                    if( edge.forward == ( ccw[edge.polygon] ? true : false ) )
+                        aParent[poly] = (int) edge.polygon;
+                    else
+                        aParent[poly] = aParent[edge.polygon];
+
+                    break;
+                }
+            }
+        }
+        else
+        {
+            auto it = pos[ev.edge];
+
+            if( it != status.begin() && std::next( it ) != status.end()
+                && meet( *std::prev( it ), *std::next( it ) ) )
+                return report( *std::prev( it ), *std::next( it ) );
+
+            status.erase( it );
+            pos[ev.edge] = status.end();
+        }
+    }
+
+    return false;
+}
+
+
+// build the counterclockwise convex hull of aPoints (monotone chain);
+// collinear points are omitted
+static void convexHull( std::vector< DOUBLET >& aPoints, std::vector< DOUBLET >& aHull )
+{
+    std::sort( aPoints.begin(), aPoints.end(), []( const DOUBLET& a, const DOUBLET& b )
+        {
+            return a.x < b.x || ( a.x == b.x && a.y < b.y );
+        } );
+
+    aPoints.erase( std::unique( aPoints.begin(), aPoints.end(),
+        []( const DOUBLET& a, const DOUBLET& b )
+        {
+            return a.x == b.x && a.y == b.y;
+        } ), aPoints.end() );
+
+    size_t np = aPoints.size();
+
+    if( np < 3 )
+    {
+        aHull = aPoints;
+        return;
+    }
+
+    aHull.assign( 2 * np, DOUBLET() );
+    size_t k = 0;
+
+    for( size_t i = 0; i < np; ++i )
+    {
+        while( k >= 2 && cross( aHull[k - 2], aHull[k - 1], aPoints[i] ) <= 0.0 )
+            --k;
+
+        aHull[k++] = aPoints[i];
+    }
+
+    for( size_t i = np - 1, t = k + 1; i > 0; --i )
+    {
+        while( k >= t && cross( aHull[k - 2], aHull[k - 1], aPoints[i - 1] ) <= 0.0 )
+            --k;
+
+        aHull[k++] = aPoints[i - 1];
+    }
+
+    aHull.resize( k - 1 );
+}
+
+
+void StadiumPolygon( const DOUBLET& aStart, const DOUBLET& aEnd, double aRadius,
+    double aDeviation, std::vector< DOUBLET >& aPolygon )
+{
+    // the stadium is the hull of the polygons of the two end circles
+    int ns = ArcSegments( aRadius, 2.0 * M_PI, aDeviation );
+    bool point = aStart.x == aEnd.x && aStart.y == aEnd.y;
+    std::vector< DOUBLET > points;
+    points.reserve( 2 * ns );
+
+    for( int i = 0; i < ns; ++i )
+    {
+        double ang = 2.0 * M_PI * i / ns;
+        double dx = aRadius * std::cos( ang );
+        double dy = aRadius * std::sin( ang );
+
+        points.push_back( DOUBLET( aStart.x + dx, aStart.y + dy ) );
+
+        if( !point )
+            points.push_back( DOUBLET( aEnd.x + dx, aEnd.y + dy ) );
+    }
+
+    convexHull( points, aPolygon );
+}
+
+
+namespace
+{
+    struct UNION_EDGE
+    {
+        DOUBLET m_p0;
+        DOUBLET m_p1;
+        size_t  m_polygon;  // index of the source polygon
+        std::vector< std::pair< double, DOUBLET > > m_splits;   // split points by parameter
+    };
+
+    struct UNION_PIECE
+    {
+        NMPOINT m_n0;       // end points rounded to nanometers for chaining
+        NMPOINT m_n1;
+        DOUBLET m_p0;
+        DOUBLET m_p1;
+    };
+}
+
+
+// parameter of the projection of aPoint onto aEdge
+static double edgeParam( const UNION_EDGE& aEdge, const DOUBLET& aPoint )
+{
+    double dx = aEdge.m_p1.x - aEdge.m_p0.x;
+    double dy = aEdge.m_p1.y - aEdge.m_p0.y;
+
+    return ( ( aPoint.x - aEdge.m_p0.x ) * dx + ( aPoint.y - aEdge.m_p0.y ) * dy )
+        / ( dx * dx + dy * dy );
+}
+
+
+// record aPoint as a split point of aEdge if it lies within the edge
+static void addSplit( UNION_EDGE& aEdge, const DOUBLET& aPoint )
+{
+    double len = std::hypot( aEdge.m_p1.x - aEdge.m_p0.x, aEdge.m_p1.y - aEdge.m_p0.y );
+    double tol = UNION_EPS / len;
+    double t = edgeParam( aEdge, aPoint );
+
+    if( t > tol && t < 1.0 - tol )
+        aEdge.m_splits.push_back( std::make_pair( t, aPoint ) );
+}
+
+
+// split two edges at their contact; collinear edges are split at each
+// other's end points so that the overlapping pieces coincide exactly
+static void splitEdges( UNION_EDGE& aA, UNION_EDGE& aB )
+{
+    double ax = aA.m_p1.x - aA.m_p0.x;
+    double ay = aA.m_p1.y - aA.m_p0.y;
+    double bx = aB.m_p1.x - aB.m_p0.x;
+    double by = aB.m_p1.y - aB.m_p0.y;
+    double lenA = std::hypot( ax, ay );
+    double lenB = std::hypot( bx, by );
+    double den = ax * by - ay * bx;
+
+    // edges which lie on one line are split at each other's end points; the
+    // test uses distances since the intersection of nearly parallel edges is
+    // ill-conditioned
+    if( ( std::fabs( cross( aA.m_p0, aA.m_p1, aB.m_p0 ) ) <= UNION_EPS * lenA
+            && std::fabs( cross( aA.m_p0, aA.m_p1, aB.m_p1 ) ) <= UNION_EPS * lenA )
+        || ( std::fabs( cross( aB.m_p0, aB.m_p1, aA.m_p0 ) ) <= UNION_EPS * lenB
+            && std::fabs( cross( aB.m_p0, aB.m_p1, aA.m_p1 ) ) <= UNION_EPS * lenB ) )
+    {
+        addSplit( aA, aB.m_p0 );
+        addSplit( aA, aB.m_p1 );
+        addSplit( aB, aA.m_p0 );
+        addSplit( aB, aA.m_p1 );
+        return;
+    }
+
+    if( std::fabs( den ) > 1.0e-12 * lenA * lenB )
+    {
+        double ex = aB.m_p0.x - aA.m_p0.x;
+        double ey = aB.m_p0.y - aA.m_p0.y;
+        double t = ( ex * by - ey * bx ) / den;
+        double u = ( ex * ay - ey * ax ) / den;
+        double tolA = UNION_EPS / lenA;
+        double tolB = UNION_EPS / lenB;
+
+        if( t < -tolA || t > 1.0 + tolA || u < -tolB || u > 1.0 + tolB )
+            return;
+
+        // a contact at an end point uses that point so that both edges are split alike
+        DOUBLET pt;
+
+        if( t <= tolA )
+            pt = aA.m_p0;
+        else if( t >= 1.0 - tolA )
+            pt = aA.m_p1;
+        else if( u <= tolB )
+            pt = aB.m_p0;
+        else if( u >= 1.0 - tolB )
+            pt = aB.m_p1;
+        else
+            pt = DOUBLET( aA.m_p0.x + t * ax, aA.m_p0.y + t * ay );
+
+        addSplit( aA, pt );
+        addSplit( aB, pt );
+    }
+}
+
+
+// a piece of an edge of polygon aPolygon lies on the boundary of the union
+// unless it is inside another polygon or coincides with the edge of another
+// polygon; of coincident edges with the same direction the one of the lowest
+// polygon is kept while edges of opposite direction separate two polygons
+static bool isBoundary( const std::vector< std::vector< DOUBLET > >& aPolygons,
+    const RTREE< size_t >& aIndex, size_t aPolygon, const DOUBLET& aP0, const DOUBLET& aP1,
+    std::vector< size_t >& aFound )
+{
+    DOUBLET mid( 0.5 * ( aP0.x + aP1.x ), 0.5 * ( aP0.y + aP1.y ) );
+    BOX2D box( mid.x, mid.y, mid.x, mid.y );
+    box.Inflate( UNION_EPS );
+    aFound.clear();
+    aIndex.Query( box, aFound );
+
+    for( auto i : aFound )
+    {
+        if( i == aPolygon )
+            continue;
+
+        const std::vector< DOUBLET >& poly = aPolygons[i];
+        size_t np = poly.size();
+        bool onEdge = false;
+
+        for( size_t j = 0, k = np - 1; j < np; k = j++ )
+        {
+            // half the split tolerance so that pieces which are taken to coincide
+            // with an edge have been split at the ends of that edge
+            if( PointDistance2( mid, poly[k], poly[j] ) > 0.25 * UNION_EPS * UNION_EPS )
+                continue;
+
+            double dot = ( aP1.x - aP0.x ) * ( poly[j].x - poly[k].x )
+                + ( aP1.y - aP0.y ) * ( poly[j].y - poly[k].y );
+
+            if( dot < 0.0 || i < aPolygon )
+                return false;
+
+            onEdge = true;
+            break;
+        }
+
+        if( !onEdge && PointInPolygon( mid, poly ) )
+            return false;
+    }
+
+    return true;
+}
+
+
+// remove the vertices between collinear edges of a closed loop
+static void mergeCollinear( std::vector< DOUBLET >& aLoop )
+{
+    bool changed = true;
+
+    while( changed && aLoop.size() > 2 )
+    {
+        changed = false;
+        std::vector< DOUBLET > out;
+        size_t np = aLoop.size();
+
+        for( size_t i = 0; i < np; ++i )
+        {
+            const DOUBLET& prev = out.empty() ? aLoop[np - 1] : out.back();
+            const DOUBLET& next = aLoop[( i + 1 ) % np];
+            double len = std::hypot( next.x - prev.x, next.y - prev.y );
+            double dot = ( aLoop[i].x - prev.x ) * ( next.x - aLoop[i].x )
+                + ( aLoop[i].y - prev.y ) * ( next.y - aLoop[i].y );
+
+            if( dot >= 0.0 && std::fabs( cross( prev, aLoop[i], next ) ) <= UNION_EPS * len )
+            {
+                changed = true;
+                continue;
+            }
+
+            out.push_back( aLoop[i] );
+        }
+
+        aLoop.swap( out );
+    }
+}
+
+
+// chain boundary pieces into loops and sort the loops into regions;
+// returns false if some loop could not be closed or a hole has no outline
+static bool chainPieces( const std::vector< UNION_PIECE >& aPieces,
+    std::vector< POLYGON_REGION >& aRegions )
+{
+    std::unordered_map< NMPOINT, std::vector< size_t >, NMPOINT_HASH > outgoing;
+    std::vector< size_t > found;
+
+    for( size_t i = 0; i < aPieces.size(); ++i )
+        outgoing[aPieces[i].m_n0].push_back( i );
+
+    // chain the aPieces into loops; where several aPieces leave a vertex the
+    // one with the sharpest left turn is taken so that touching loops separate
+    RTREE< size_t > startIndex;
+
+    for( size_t i = 0; i < aPieces.size(); ++i )
+        startIndex.Insert( BOX2D( aPieces[i].m_p0.x, aPieces[i].m_p0.y,
+            aPieces[i].m_p0.x, aPieces[i].m_p0.y ), i );
+
+    startIndex.Build();
+    std::vector< char > used( aPieces.size(), 0 );
+    std::vector< std::vector< DOUBLET > > outlines;
+    std::vector< std::vector< DOUBLET > > holes;
+    bool closed = true;
+
+    for( size_t first = 0; first < aPieces.size(); ++first )
+    {
+        if( used[first] )
+            continue;
+
+        std::vector< DOUBLET > loop;
+        size_t cur = first;
+        bool ok = false;
+
+        while( true )
+        {
+            used[cur] = 1;
+            loop.push_back( aPieces[cur].m_p0 );
+
+            if( aPieces[cur].m_n1 == aPieces[first].m_n0 )
+            {
+                ok = true;
+                break;
+            }
+
+            const UNION_PIECE& in = aPieces[cur];
+            double dx0 = in.m_p1.x - in.m_p0.x;
+            double dy0 = in.m_p1.y - in.m_p0.y;
+            double best = -4.0;
+            size_t next = aPieces.size();
+
+            for( auto i : outgoing[in.m_n1] )
+            {
+                if( used[i] )
+                    continue;
+
+                double dx1 = aPieces[i].m_p1.x - aPieces[i].m_p0.x;
+                double dy1 = aPieces[i].m_p1.y - aPieces[i].m_p0.y;
+                double turn = std::atan2( dx0 * dy1 - dy0 * dx1, dx0 * dx1 + dy0 * dy1 );
+
+                if( turn > best )
+                {
+                    best = turn;
+                    next = i;
+                }
+            }
+
+            // close small gaps left where several edges meet almost at one point
+            if( next == aPieces.size() )
+            {
+                double gap2 = CONTACT_DIST * CONTACT_DIST;
+                double dx = in.m_p1.x - aPieces[first].m_p0.x;
+                double dy = in.m_p1.y - aPieces[first].m_p0.y;
+
+                if( dx * dx + dy * dy <= gap2 )
+                {
+                    ok = true;
+                    break;
+                }
+
+                BOX2D box( in.m_p1.x, in.m_p1.y, in.m_p1.x, in.m_p1.y );
+                box.Inflate( CONTACT_DIST );
+                found.clear();
+                startIndex.Query( box, found );
+
+                for( auto i : found )
+                {
+                    dx = aPieces[i].m_p0.x - in.m_p1.x;
+                    dy = aPieces[i].m_p0.y - in.m_p1.y;
+
+                    if( !used[i] && dx * dx + dy * dy <= gap2 )
+                    {
+                        gap2 = dx * dx + dy * dy;
+                        next = i;
+                    }
+                }
+            }
+
+            if( next == aPieces.size() )
+                break;
+
+            cur = next;
+        }
+
+        if( !ok )
+        {
+            closed = false;
+            continue;
+        }
+
+        mergeCollinear( loop );
+
+        if( loop.size() < 3 )
+            continue;
+
+        double area = PolygonArea( loop );
+
+        if( area > UNION_EPS * UNION_EPS )
+            outlines.push_back( loop );
+        else if( area < -UNION_EPS * UNION_EPS )
+            holes.push_back( loop );
+    }
+
+    // each hole belongs to the smallest outline which encloses it
+    size_t base = aRegions.size();
+    std::vector< double > areas;
+
+    for( auto& i : outlines )
+    {
+        POLYGON_REGION region;
+        region.m_outline.swap( i );
+        areas.push_back( PolygonArea( region.m_outline ) );
+        aRegions.push_back( region );
+    }
+
+    for( auto& hole : holes )
+    {
+        DOUBLET mid( 0.5 * ( hole[0].x + hole[1].x ), 0.5 * ( hole[0].y + hole[1].y ) );
+        size_t owner = aRegions.size();
+
+        for( size_t i = base; i < aRegions.size(); ++i )
+        {
+            if( ( owner == aRegions.size() || areas[i - base] < areas[owner - base] )
+                && PointInPolygon( mid, aRegions[i].m_outline ) )
+                owner = i;
+        }
+
+        if( owner < aRegions.size() )
+            aRegions[owner].m_holes.push_back( hole );
+        else
+            closed = false;
+    }
+
+    return closed;
+}
+
+
+bool PolygonUnion( const std::vector< std::vector< DOUBLET > >& aPolygons,
+    std::vector< POLYGON_REGION >& aRegions )
+{
+    std::vector< UNION_EDGE > edges;
+    RTREE< size_t > edgeIndex;
+    RTREE< size_t > polyIndex;
+
+    for( size_t i = 0; i < aPolygons.size(); ++i )
+    {
+        const std::vector< DOUBLET >& poly = aPolygons[i];
+        size_t np = poly.size();
+        BOX2D pbox;
+
+        if( np < 3 )
+            continue;
+
+        for( size_t j = 0; j < np; ++j )
+        {
+            UNION_EDGE edge;
+            edge.m_p0 = poly[j];
+            edge.m_p1 = poly[( j + 1 ) % np];
+            edge.m_polygon = i;
+
+            if( edge.m_p0.x == edge.m_p1.x && edge.m_p0.y == edge.m_p1.y )
+                continue;
+
+            BOX2D box( edge.m_p0.x, edge.m_p0.y, edge.m_p1.x, edge.m_p1.y );
+            box.Inflate( UNION_EPS );
+            edgeIndex.Insert( box, edges.size() );
+            edges.push_back( edge );
+            pbox.Add( box );
+        }
+
+        polyIndex.Insert( pbox, i );
+    }
+
+    edgeIndex.Build();
+    polyIndex.Build();
+
+    // split the edges where they meet the edges of other polygons
+    std::vector< size_t > found;
+
+    for( size_t i = 0; i < edges.size(); ++i )
+    {
+        BOX2D box( edges[i].m_p0.x, edges[i].m_p0.y, edges[i].m_p1.x, edges[i].m_p1.y );
+        box.Inflate( UNION_EPS );
+        found.clear();
+        edgeIndex.Query( box, found );
+
+        for( auto j : found )
+        {
+            if( j > i && edges[j].m_polygon != edges[i].m_polygon )
+                splitEdges( edges[i], edges[j] );
+        }
+    }
+
+    // keep the pieces which bound the union
+    std::vector< UNION_PIECE > pieces;
+
+    for( auto& edge : edges )
+    {
+        std::sort( edge.m_splits.begin(), edge.m_splits.end(),
+            []( const std::pair< double, DOUBLET >& a, const std::pair< double, DOUBLET >& b )
+            {
+                return a.first < b.first;
+            } );
+
+        std::vector< DOUBLET > pts;
+        pts.push_back( edge.m_p0 );
+
+        for( auto& i : edge.m_splits )
+            pts.push_back( i.second );
+
+        pts.push_back( edge.m_p1 );
+
+        for( size_t i = 1; i < pts.size(); ++i )
+        {
+            UNION_PIECE piece;
+            piece.m_n0 = ToNM( pts[i - 1] );
+            piece.m_n1 = ToNM( pts[i] );
+
+            if( piece.m_n0 == piece.m_n1 )
+                continue;
+
+            if( !isBoundary( aPolygons, polyIndex, edge.m_polygon, pts[i - 1], pts[i], found ) )
+                continue;
+
+            piece.m_p0 = pts[i - 1];
+            piece.m_p1 = pts[i];
+            pieces.push_back( piece );
+        }
+    }
+
+    return chainPieces( pieces, aRegions );
+}
+
+
+bool UnfracturePolygon( const std::vector< DOUBLET >& aPolygon,
+    std::vector< POLYGON_REGION >& aRegions )
+{
+    size_t np = aPolygon.size();
+
+    if( np < 3 )
+        return true;
+
+    // the outline must be counterclockwise so that the holes are clockwise
+    bool reverse = PolygonArea( aPolygon ) < 0.0;
+    std::vector< UNION_PIECE > pieces;
+    pieces.reserve( np );
+
+    for( size_t i = 0; i < np; ++i )
+    {
+        UNION_PIECE piece;
+        piece.m_p0 = aPolygon[reverse ? np - 1 - i : i];
+        piece.m_p1 = aPolygon[reverse ? ( 2 * np - 2 - i ) % np : ( i + 1 ) % np];
+        piece.m_n0 = ToNM( piece.m_p0 );
+        piece.m_n1 = ToNM( piece.m_p1 );
+
+        if( piece.m_n0 != piece.m_n1 )
+            pieces.push_back( piece );
+    }
+
+    // remove the pairs of opposite edges which join the holes to the outline
+    typedef std::array< int64_t, 4 > EDGE_KEY;
+    std::map< EDGE_KEY, std::vector< size_t > > open;
+    std::vector< char > keep( pieces.size(), 1 );
+
+    for( size_t i = 0; i < pieces.size(); ++i )
+    {
+        const UNION_PIECE& piece = pieces[i];
+        EDGE_KEY rkey = {{ piece.m_n1.x, piece.m_n1.y, piece.m_n0.x, piece.m_n0.y }};
+        auto rev = open.find( rkey );
+
+        if( rev != open.end() && !rev->second.empty() )
+        {
+            keep[rev->second.back()] = 0;
+            keep[i] = 0;
+            rev->second.pop_back();
+            continue;
+        }
+
+        EDGE_KEY key = {{ piece.m_n0.x, piece.m_n0.y, piece.m_n1.x, piece.m_n1.y }};
+        open[key].push_back( i );
+    }
+
+    std::vector< UNION_PIECE > boundary;
+    boundary.reserve( pieces.size() );
+
+    for( size_t i = 0; i < pieces.size(); ++i )
+    {
+        if( keep[i] )
+            boundary.push_back( pieces[i] );
+    }
+
+    pieces.clear();
+
+    return chainPieces( boundary, aRegions );
+}
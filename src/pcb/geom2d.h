@@ -0,0 +1,146 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+/**
+ * @file geom2d.h
+ * provides elementary 2D geometry functions used to check and
+ * prepare board profiles before the solid model is created.
+ */
+
+#ifndef KICAD2MCAD_GEOM2D_H
+#define KICAD2MCAD_GEOM2D_H
+
+#include <cstddef>
+#include <vector>
+#include "base.h"
+
+
+/**
+ * Function PointDistance2
+ * returns the square of the distance between aPoint and the segment aS0-aS1.
+ */
+double PointDistance2( const DOUBLET& aPoint, const DOUBLET& aS0, const DOUBLET& aS1 );
+
+/**
+ * Function SegmentDistance2
+ * returns the square of the distance between the segments aA0-aA1
+ * and aB0-aB1; the distance is 0 if the segments intersect.
+ */
+double SegmentDistance2( const DOUBLET& aA0, const DOUBLET& aA1,
+    const DOUBLET& aB0, const DOUBLET& aB1 );
+
+/**
+ * Function PolygonArea
+ * returns the signed area of a closed polygon; the area is
+ * positive if the vertices are in counterclockwise order.
+ */
+double PolygonArea( const std::vector< DOUBLET >& aPolygon );
+
+/**
+ * Function PointInPolygon
+ * returns true if aPoint lies within the closed polygon aPolygon;
+ * the result for points on the boundary is undefined.
+ */
+bool PointInPolygon( const DOUBLET& aPoint, const std::vector< DOUBLET >& aPolygon );
+
+/**
+ * Function CircleCenter
+ * computes the center of the circle through three points; returns
+ * false if the points are collinear.
+ */
+bool CircleCenter( const DOUBLET& aP0, const DOUBLET& aP1, const DOUBLET& aP2, DOUBLET& aCenter );
+
+/**
+ * Function ArcSegments
+ * returns the number of chords required to approximate an arc of
+ * radius aRadius and angle aAngle (radians) such that no chord
+ * deviates from the arc by more than aDeviation.
+ */
+int ArcSegments( double aRadius, double aAngle, double aDeviation );
+
+/**
+ * Struct POLYGON_CONTACT
+ * describes the first contact found between the edges of polygons.
+ */
+struct POLYGON_CONTACT
+{
+    size_t  m_polygon0; // polygons whose edges meet; the same if a polygon meets itself
+    size_t  m_polygon1;
+    DOUBLET m_point;    // location of the contact
+};
+
+/**
+ * Function FindPolygonContact
+ * sweeps the edges of the closed polygons from left to right (Shamos-Hoey)
+ * and stops at the first pair of edges which touch or cross; the edges of
+ * a polygon which share a vertex may meet only at that vertex. The test
+ * takes O(n log n) time for n edges. Returns true if a contact was found.
+ * If no contact was found aParent receives for each polygon the index of
+ * the innermost polygon which encloses it (-1 = none).
+ */
+bool FindPolygonContact( const std::vector< std::vector< DOUBLET > >& aPolygons,
+    POLYGON_CONTACT& aContact, std::vector< int >& aParent );
+
+/**
+ * Function StadiumPolygon
+ * sets aPolygon to the counterclockwise outline of a track of width
+ * 2 * aRadius from aStart to aEnd with round ends. The vertices of the
+ * ends lie at fixed angles so that the ends of tracks of the same width
+ * which meet at a point coincide exactly.
+ */
+void StadiumPolygon( const DOUBLET& aStart, const DOUBLET& aEnd, double aRadius,
+    double aDeviation, std::vector< DOUBLET >& aPolygon );
+
+/**
+ * Struct POLYGON_REGION
+ * is a connected area bounded by a counterclockwise outline and any
+ * number of clockwise holes.
+ */
+struct POLYGON_REGION
+{
+    std::vector< DOUBLET >                  m_outline;
+    std::vector< std::vector< DOUBLET > >   m_holes;
+};
+
+/**
+ * Function PolygonUnion
+ * merges the simple counterclockwise polygons aPolygons into disjoint
+ * regions. All edges are split where they meet other edges and only the
+ * pieces on the boundary of the union are kept and chained into loops;
+ * an R-tree limits the tests to nearby edges. Returns false if some
+ * boundary could not be closed, in which case it is omitted from aRegions.
+ */
+bool PolygonUnion( const std::vector< std::vector< DOUBLET > >& aPolygons,
+    std::vector< POLYGON_REGION >& aRegions );
+
+/**
+ * Function UnfracturePolygon
+ * converts a polygon whose holes are joined to the outline by pairs of
+ * coincident opposite edges, as in the zone fills of KiCad, into regions
+ * with separate holes. Returns false if some loop could not be closed.
+ */
+bool UnfracturePolygon( const std::vector< DOUBLET >& aPolygon,
+    std::vector< POLYGON_REGION >& aRegions );
+
+#endif  // KICAD2MCAD_GEOM2D_H
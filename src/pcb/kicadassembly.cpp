@@ -0,0 +1,315 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+#include <wx/filename.h>
+#include <wx/log.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+#include "kicadassembly.h"
+#include "kicadpcb.h"
+#include "sexpr/sexpr.h"
+#include "sexpr/sexpr_parser.h"
+#include "oce_utils.h"
+#include "parallel.h"
+
+
+KICADASSEMBLY::KICADASSEMBLY()
+{
+    m_system = NULL;
+    m_threads = 0;
+    return;
+}
+
+
+KICADASSEMBLY::~KICADASSEMBLY()
+{
+    clear();
+    return;
+}
+
+
+void KICADASSEMBLY::clear()
+{
+    // the boards are built in the document of the system
+    // assembly and are released first
+    for( auto& i : m_boards )
+        delete i.m_pcb;
+
+    m_boards.clear();
+
+    if( m_system )
+        delete m_system;
+
+    m_system = NULL;
+    return;
+}
+
+
+bool KICADASSEMBLY::ReadFile( const wxString& aFileName )
+{
+    clear();
+
+    wxFileName fname( aFileName );
+
+    if( !fname.FileExists() )
+    {
+        std::ostringstream ostr;
+        ostr << "* no such file: '" << aFileName.ToUTF8() << "'\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    fname.Normalize();
+    m_filename = fname.GetFullPath().ToUTF8();
+    SEXPR::SEXPR* data = NULL;
+
+    try
+    {
+        SEXPR::PARSER parser;
+        data = parser.ParseFromFile( m_filename );
+    }
+    catch( std::exception& e )
+    {
+        std::ostringstream ostr;
+        ostr << "* error reading file: '" << m_filename << "'\n";
+        ostr << "  * " << e.what() << "\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    if( NULL == data || !data->IsList() || data->GetNumberOfChildren() < 1
+        || !data->GetChild( 0 )->IsSymbol()
+        || data->GetChild( 0 )->GetSymbol() != "kicad_assembly" )
+    {
+        std::ostringstream ostr;
+        ostr << "* data is not a valid assembly file: '" << m_filename << "'\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        delete data;
+        return false;
+    }
+
+    bool result = true;
+    size_t nc = data->GetNumberOfChildren();
+
+    for( size_t i = 1; i < nc && result; ++i )
+    {
+        SEXPR::SEXPR* child = data->GetChild( i );
+
+        if( child->IsList() && child->GetNumberOfChildren() > 0
+            && child->GetChild( 0 )->IsSymbol() && child->GetChild( 0 )->GetSymbol() == "board" )
+        {
+            result = parseBoard( child, fname.GetPath() );
+        }
+    }
+
+    delete data;
+
+    if( result && m_boards.empty() )
+    {
+        std::ostringstream ostr;
+        ostr << "* no boards in assembly file: '" << m_filename << "'\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        result = false;
+    }
+
+    if( !result )
+        clear();
+
+    return result;
+}
+
+
+bool KICADASSEMBLY::parseBoard( SEXPR::SEXPR* aEntry, const wxString& aDir )
+{
+    // form: (board "file.kicad_pcb" {(name N)} {(at X Y Z)} {(rotate X Y Z)})
+    int nchild = aEntry->GetNumberOfChildren();
+    BOARD_ENTRY board;
+    SEXPR::SEXPR* child = nchild > 1 ? aEntry->GetChild( 1 ) : NULL;
+
+    if( NULL == child || !( child->IsString() || child->IsSymbol() ) )
+    {
+        std::ostringstream ostr;
+        ostr << "* corrupt assembly file: '" << m_filename << "'; board without a file name\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    wxFileName fname( wxString::FromUTF8( child->IsString() ?
+        child->GetString().c_str() : child->GetSymbol().c_str() ) );
+    fname.MakeAbsolute( aDir );
+    board.m_filename = fname.GetFullPath().ToUTF8();
+    board.m_name = fname.GetName().ToUTF8();
+
+    for( int i = 2; i < nchild; ++i )
+    {
+        child = aEntry->GetChild( i );
+
+        if( !child->IsList() || child->GetNumberOfChildren() < 2 )
+            continue;
+
+        std::string name = child->GetChild( 0 )->GetSymbol();
+        bool ret = true;
+
+        if( name == "name" )
+        {
+            SEXPR::SEXPR* val = child->GetChild( 1 );
+
+            if( val->IsString() )
+                board.m_name = val->GetString();
+            else if( val->IsSymbol() )
+                board.m_name = val->GetSymbol();
+        }
+        else if( name == "at" )
+        {
+            ret = Get3DCoordinate( child, board.m_position );
+        }
+        else if( name == "rotate" )
+        {
+            ret = Get3DCoordinate( child, board.m_rotation );
+        }
+
+        if( !ret )
+        {
+            std::ostringstream ostr;
+            ostr << "* corrupt assembly file: '" << m_filename << "'; bad placement of board '";
+            ostr << board.m_name << "'\n";
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+            return false;
+        }
+    }
+
+    board.m_pcb = new KICADPCB;
+    m_boards.push_back( board );
+    return true;
+}
+
+
+bool KICADASSEMBLY::ComposeAssembly()
+{
+    if( m_boards.empty() )
+        return false;
+
+    if( m_system )
+    {
+        for( auto& i : m_boards )
+            i.m_pcb->ReleaseModel();
+
+        delete m_system;
+    }
+
+    m_system = new PCBMODEL();
+    std::vector< char > ok( m_boards.size(), 0 );
+
+    // the boards are composed concurrently and each board runs its own
+    // parallel loops, so the threads are divided among the boards
+    unsigned nThreads = GetThreadCount( m_threads );
+    unsigned nOuter = (unsigned) std::min( (size_t) nThreads, m_boards.size() );
+    unsigned nInner = std::max( 1u, nThreads / nOuter );
+
+    for( auto& i : m_boards )
+    {
+        i.m_pcb->SetSystem( m_system );
+        i.m_pcb->SetThreadCount( nInner );
+    }
+
+    // each board is read and composed on its own thread; the document
+    // is only locked while a board adds its solids and models to it
+    ParallelFor( m_boards.size(), nOuter, [&]( size_t aIndex )
+        {
+            KICADPCB* pcb = m_boards[aIndex].m_pcb;
+            wxString fname = wxString::FromUTF8( m_boards[aIndex].m_filename.c_str() );
+
+            // exceptions must not escape the worker thread
+            try
+            {
+                if( pcb->ReadFile( fname ) && pcb->ComposePCB() )
+                    ok[aIndex] = 1;
+            }
+            catch( ... )
+            {
+                std::ostringstream ostr;
+                ostr << "** exception while composing board '" << m_boards[aIndex].m_name << "'\n";
+                wxLogMessage( "%s\n", ostr.str().c_str() );
+            }
+        } );
+
+    wxLog::FlushActive();
+
+    bool result = true;
+
+    for( size_t i = 0; i < m_boards.size(); ++i )
+    {
+        BOARD_ENTRY& board = m_boards[i];
+
+        if( !ok[i] || !m_system->AddBoard( board.m_pcb->GetModel(), board.m_name,
+            board.m_position, board.m_rotation ) )
+        {
+            std::ostringstream ostr;
+            ostr << "** " << __FILE__ << ":" << __FUNCTION__ << ":" << __LINE__ << "\n";
+            ostr << "*  could not compose board '" << board.m_name << "' (";
+            ostr << board.m_filename << ")\n";
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+
+bool KICADASSEMBLY::CheckShapes()
+{
+    if( m_system )
+        return m_system->CheckShapes();
+
+    return false;
+}
+
+
+bool KICADASSEMBLY::WriteSTEP( const wxString& aFileName, bool aOverwrite )
+{
+    if( m_system )
+    {
+        std::string filename( aFileName.ToUTF8() );
+        return m_system->WriteSTEP( filename, aOverwrite );
+    }
+
+    return false;
+}
+
+
+#ifdef SUPPORTS_IGES
+bool KICADASSEMBLY::WriteIGES( const wxString& aFileName, bool aOverwrite )
+{
+    if( m_system )
+    {
+        std::string filename( aFileName.ToUTF8() );
+        return m_system->WriteIGES( filename, aOverwrite );
+    }
+
+    return false;
+}
+#endif
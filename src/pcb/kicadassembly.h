@@ -0,0 +1,113 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+/**
+ * @file kicadassembly.h
+ * declares the description of a system of several boards which are
+ * composed concurrently and exported as a single assembly.
+ */
+
+#ifndef KICADASSEMBLY_H
+#define KICADASSEMBLY_H
+
+#include <wx/string.h>
+#include <string>
+#include <vector>
+#include "base.h"
+
+#ifdef SUPPORTS_IGES
+#undef SUPPORTS_IGES
+#endif
+
+namespace SEXPR
+{
+    class SEXPR;
+}
+
+class KICADPCB;
+class PCBMODEL;
+
+
+class KICADASSEMBLY
+{
+private:
+    struct BOARD_ENTRY
+    {
+        std::string m_filename;     // board file (absolute path)
+        std::string m_name;         // name of the board in the assembly
+        TRIPLET     m_position;     // placement of the board, mm
+        TRIPLET     m_rotation;     // rotation about X, Y, Z (degrees)
+        KICADPCB*   m_pcb;
+    };
+
+    std::string                 m_filename;
+    std::vector< BOARD_ENTRY >  m_boards;
+    PCBMODEL*                   m_system;   // assembly of all boards
+    unsigned                    m_threads;  // number of boards composed at once (0 = hardware threads)
+
+    bool parseBoard( SEXPR::SEXPR* aEntry, const wxString& aDir );
+    void clear();
+
+public:
+    KICADASSEMBLY();
+    virtual ~KICADASSEMBLY();
+
+    // read the assembly description; form:
+    // (kicad_assembly (board "file.kicad_pcb" {(name N)} {(at X Y Z)} {(rotate X Y Z)}) ...)
+    // relative board file names are relative to the description
+    bool ReadFile( const wxString& aFileName );
+
+    // total number of threads (0 = hardware threads); the threads are
+    // divided among the boards, which replaces their own thread counts
+    void SetThreadCount( unsigned aThreads )
+    {
+        m_threads = aThreads;
+    }
+
+    // retrieve the boards so that the export options may be applied to each
+    size_t GetBoardCount() const
+    {
+        return m_boards.size();
+    }
+
+    KICADPCB* GetBoard( size_t aIndex ) const
+    {
+        return aIndex < m_boards.size() ? m_boards[aIndex].m_pcb : NULL;
+    }
+
+    // read and compose each board on a separate thread into the document of
+    // one system assembly; the models are shared by all boards so that each
+    // model file is read once. The boards are then placed in the assembly
+    bool ComposeAssembly();
+
+    // validate the solids of each board and of the shared models
+    bool CheckShapes();
+
+    bool WriteSTEP( const wxString& aFileName, bool aOverwrite );
+    #ifdef SUPPORTS_IGES
+    bool WriteIGES( const wxString& aFileName, bool aOverwrite );
+    #endif
+};
+
+#endif  // KICADASSEMBLY_H
@@ -27,6 +27,7 @@
 #include <math.h>
 #include "sexpr/sexpr.h"
 #include "kicadcurve.h"
+#include "pcbcache.h"
 
 
 KICADCURVE::KICADCURVE()
@@ -86,13 +87,17 @@ bool KICADCURVE::Read( SEXPR::SEXPR* aEntry, CURVE_TYPE aCurveType )
 
         if( text == "start" || text == "center" )
         {
-            if( !Get2DCoordinate( child, m_start ) )
+            if( !Get2DCoordinate( child, m_nmStart ) )
                 return false;
+
+            m_start = ToMM( m_nmStart );
         }
         else if( text == "end" )
         {
-            if( !Get2DCoordinate( child, m_end ) )
+            if( !Get2DCoordinate( child, m_nmEnd ) )
                 return false;
+
+            m_end = ToMM( m_nmEnd );
         }
         else if( text == "angle" )
         {
@@ -134,3 +139,37 @@ bool KICADCURVE::Read( SEXPR::SEXPR* aEntry, CURVE_TYPE aCurveType )
 
     return true;
 }
+
+
+void KICADCURVE::WriteCache( CACHE_WRITER& aCache ) const
+{
+    aCache.PutInt( m_form );
+    aCache.PutInt( m_layer );
+    aCache.PutPoint( m_nmStart );
+    aCache.PutPoint( m_nmEnd );
+    aCache.PutDouble( m_angle );
+    return;
+}
+
+
+bool KICADCURVE::ReadCache( CACHE_READER& aCache )
+{
+    int64_t form = aCache.GetInt();
+    int64_t layer = aCache.GetInt();
+
+    if( form < CURVE_NONE || form > CURVE_CIRCLE || layer < LAYER_NONE || layer > LAYER_EDGE )
+    {
+        aCache.Invalidate();
+        return false;
+    }
+
+    m_form = (CURVE_TYPE) form;
+    m_layer = (LAYERS) layer;
+    m_nmStart = aCache.GetPoint();
+    m_nmEnd = aCache.GetPoint();
+    m_start = ToMM( m_nmStart );
+    m_end = ToMM( m_nmEnd );
+    m_angle = aCache.GetDouble();
+
+    return aCache.IsOK();
+}
@@ -33,6 +33,9 @@
 #include <vector>
 #include "base.h"
 
+class CACHE_READER;
+class CACHE_WRITER;
+
 
 class KICADCURVE
 {
@@ -42,6 +45,10 @@ public:
 
     bool Read( SEXPR::SEXPR* aEntry, CURVE_TYPE aCurveType );
 
+    // store or restore the parsed data in a board cache
+    void WriteCache( CACHE_WRITER& aCache ) const;
+    bool ReadCache( CACHE_READER& aCache );
+
     LAYERS GetLayer()
     {
         return m_layer;
@@ -51,6 +58,8 @@ public:
     LAYERS     m_layer; // layer of the glyph
     DOUBLET    m_start; // start point of line or center for arc and circle
     DOUBLET    m_end;   // end point of line, first point on arc or circle
+    NMPOINT    m_nmStart;   // m_start in exact nanometers
+    NMPOINT    m_nmEnd;     // m_end in exact nanometers
     DOUBLET    m_ep;    // actual endpoint, to be computed in the case of arcs
     double     m_radius;// radius; to be computed in the case of arcs and circles
     double     m_angle; // subtended angle of arc
@@ -26,6 +26,7 @@
 #include <sstream>
 #include "sexpr/sexpr.h"
 #include "kicadmodel.h"
+#include "pcbcache.h"
 
 
 KICADMODEL::KICADMODEL() : m_scale( 1.0, 1.0, 1.0 )
@@ -90,3 +91,24 @@ bool KICADMODEL::Read( SEXPR::SEXPR* aEntry )
 
     return true;
 }
+
+
+void KICADMODEL::WriteCache( CACHE_WRITER& aCache ) const
+{
+    aCache.PutString( m_modelname );
+    aCache.PutTriplet( m_scale );
+    aCache.PutTriplet( m_offset );
+    aCache.PutTriplet( m_rotation );
+    return;
+}
+
+
+bool KICADMODEL::ReadCache( CACHE_READER& aCache )
+{
+    m_modelname = aCache.GetString();
+    m_scale = aCache.GetTriplet();
+    m_offset = aCache.GetTriplet();
+    m_rotation = aCache.GetTriplet();
+
+    return aCache.IsOK();
+}
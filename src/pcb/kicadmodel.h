@@ -31,6 +31,9 @@
 
 #include "base.h"
 
+class CACHE_READER;
+class CACHE_WRITER;
+
 struct KICADMODEL
 {
     KICADMODEL();
@@ -38,6 +41,10 @@ struct KICADMODEL
 
     bool Read( SEXPR::SEXPR* aEntry );
 
+    // store or restore the parsed data in a board cache
+    void WriteCache( CACHE_WRITER& aCache ) const;
+    bool ReadCache( CACHE_READER& aCache );
+
     std::string m_modelname;
     TRIPLET     m_scale;
     TRIPLET     m_offset;
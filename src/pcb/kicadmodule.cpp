@@ -22,6 +22,8 @@
  */
 
 #include <wx/log.h>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <limits>
 #include <sstream>
@@ -33,18 +35,77 @@
 #include "kicadpad.h"
 #include "kicadcurve.h"
 #include "oce_utils.h"
+#include "pcbcache.h"
 
 
-KICADMODULE::KICADMODULE()
+// returns true if the named module entry is part of the local geometry
+static bool isFootprintEntry( const std::string& aName )
 {
-    m_side = LAYER_NONE;
-    m_rotation = 0.0;
+    return aName == "fp_arc" || aName == "fp_line" || aName == "fp_circle"
+        || aName == "pad" || aName == "model";
+}
+
+
+// hash the content of an expression; net assignments and timestamps
+// differ between instances of a footprint and are ignored
+static uint64_t hashSexpr( SEXPR::SEXPR* aData, uint64_t aHash )
+{
+    char tag;
+
+    if( aData->IsList() )
+    {
+        size_t nc = aData->GetNumberOfChildren();
+
+        if( nc > 0 && aData->GetChild( 0 )->IsSymbol() )
+        {
+            const std::string& name = aData->GetChild( 0 )->GetSymbol();
+
+            if( name == "net" || name == "tstamp" )
+                return aHash;
+        }
+
+        tag = '(';
+        aHash = HashBytes( &tag, 1, aHash );
+
+        for( size_t i = 0; i < nc; ++i )
+            aHash = hashSexpr( aData->GetChild( i ), aHash );
+
+        tag = ')';
+        return HashBytes( &tag, 1, aHash );
+    }
+
+    if( aData->IsDouble() )
+    {
+        double val = aData->GetDouble();
+        tag = 'd';
+        aHash = HashBytes( &tag, 1, aHash );
+        return HashBytes( &val, sizeof( val ), aHash );
+    }
+
+    if( aData->IsInteger() )
+    {
+        int64_t val = aData->GetLongInteger();
+        tag = 'i';
+        aHash = HashBytes( &tag, 1, aHash );
+        return HashBytes( &val, sizeof( val ), aHash );
+    }
 
+    const std::string& text = aData->IsString() ? aData->GetString() : aData->GetSymbol();
+    tag = aData->IsString() ? 's' : 'y';
+    aHash = HashBytes( &tag, 1, aHash );
+    aHash = HashBytes( text.data(), text.size(), aHash );
+    tag = 0;
+    return HashBytes( &tag, 1, aHash );
+}
+
+
+KICADFOOTPRINT::KICADFOOTPRINT()
+{
     return;
 }
 
 
-KICADMODULE::~KICADMODULE()
+KICADFOOTPRINT::~KICADFOOTPRINT()
 {
     for( auto i : m_pads )
         delete i;
@@ -59,7 +120,84 @@ KICADMODULE::~KICADMODULE()
 }
 
 
-bool KICADMODULE::Read( SEXPR::SEXPR* aEntry )
+void KICADFOOTPRINT::WriteCache( CACHE_WRITER& aCache ) const
+{
+    aCache.PutInt( (int64_t) m_pads.size() );
+
+    for( auto i : m_pads )
+        i->WriteCache( aCache );
+
+    aCache.PutInt( (int64_t) m_curves.size() );
+
+    for( auto i : m_curves )
+        i->WriteCache( aCache );
+
+    aCache.PutInt( (int64_t) m_models.size() );
+
+    for( auto i : m_models )
+        i->WriteCache( aCache );
+
+    aCache.PutBox( m_bbox );
+    return;
+}
+
+
+bool KICADFOOTPRINT::ReadCache( CACHE_READER& aCache )
+{
+    int64_t n = aCache.GetInt();
+
+    for( int64_t i = 0; i < n && aCache.IsOK(); ++i )
+    {
+        KICADPAD* mp = new KICADPAD();
+        m_pads.push_back( mp );
+
+        if( !mp->ReadCache( aCache ) )
+            return false;
+    }
+
+    n = aCache.GetInt();
+
+    for( int64_t i = 0; i < n && aCache.IsOK(); ++i )
+    {
+        KICADCURVE* mp = new KICADCURVE();
+        m_curves.push_back( mp );
+
+        if( !mp->ReadCache( aCache ) )
+            return false;
+    }
+
+    n = aCache.GetInt();
+
+    for( int64_t i = 0; i < n && aCache.IsOK(); ++i )
+    {
+        KICADMODEL* mp = new KICADMODEL();
+        m_models.push_back( mp );
+
+        if( !mp->ReadCache( aCache ) )
+            return false;
+    }
+
+    m_bbox = aCache.GetBox();
+    return aCache.IsOK();
+}
+
+
+KICADMODULE::KICADMODULE()
+{
+    m_side = LAYER_NONE;
+    m_rotation = 0.0;
+
+    return;
+}
+
+
+KICADMODULE::~KICADMODULE()
+{
+    return;
+}
+
+
+bool KICADMODULE::Read( SEXPR::SEXPR* aEntry, FOOTPRINT_MAP* aFootprints )
 {
     if( NULL == aEntry )
         return false;
@@ -78,6 +216,33 @@ bool KICADMODULE::Read( SEXPR::SEXPR* aEntry )
             return false;
         }
 
+        // look up a definition with identical local geometry; the key is a
+        // hash of the footprint body excluding the placement and reference
+        std::shared_ptr< KICADFOOTPRINT > footprint;
+        uint64_t hash = HASH_SEED;
+        m_footprint.reset();
+
+        if( aFootprints )
+        {
+            for( size_t i = 1; i < nc; ++i )
+            {
+                child = aEntry->GetChild( i );
+
+                if( child->IsList() && child->GetNumberOfChildren() > 0
+                    && child->GetChild( 0 )->IsSymbol()
+                    && isFootprintEntry( child->GetChild( 0 )->GetSymbol() ) )
+                    hash = hashSexpr( child, hash );
+            }
+
+            FOOTPRINT_MAP::const_iterator fp = aFootprints->find( hash );
+
+            if( fp != aFootprints->end() )
+                m_footprint = fp->second;
+        }
+
+        if( !m_footprint )
+            footprint.reset( new KICADFOOTPRINT );
+
         bool result = true;
 
         for( size_t i = 1; i < nc && result; ++i )
@@ -106,19 +271,32 @@ bool KICADMODULE::Read( SEXPR::SEXPR* aEntry )
                 result = result && parsePosition( child );
             else if( symname == "fp_text" )
                 result = result && parseText( child );
+            else if( !footprint )
+                continue;   // the shared definition has already been parsed
             else if( symname == "fp_arc" )
-                result = result && parseCurve( child, CURVE_ARC );
+                result = result && parseCurve( child, CURVE_ARC, footprint.get() );
             else if( symname == "fp_line" )
-                result = result && parseCurve( child, CURVE_LINE );
+                result = result && parseCurve( child, CURVE_LINE, footprint.get() );
             else if( symname == "fp_circle" )
-                result = result && parseCurve( child, CURVE_CIRCLE );
+                result = result && parseCurve( child, CURVE_CIRCLE, footprint.get() );
             else if( symname == "pad" )
-                result = result && parsePad( child );
+                result = result && parsePad( child, footprint.get() );
             else if( symname == "model" )
-                result = result && parseModel( child );
+                result = result && parseModel( child, footprint.get() );
+        }
+
+        if( !result )
+            return false;
+
+        if( footprint )
+        {
+            m_footprint = footprint;
+
+            if( aFootprints )
+                aFootprints->insert( std::make_pair( hash, m_footprint ) );
         }
 
-        return result;
+        return true;
     }
 
     std::ostringstream ostr;
@@ -129,7 +307,38 @@ bool KICADMODULE::Read( SEXPR::SEXPR* aEntry )
 }
 
 
-bool KICADMODULE::parseModel( SEXPR::SEXPR* data )
+void KICADMODULE::WriteCache( CACHE_WRITER& aCache ) const
+{
+    aCache.PutInt( m_side );
+    aCache.PutString( m_refdes );
+    aCache.PutDoublet( m_position );
+    aCache.PutDouble( m_rotation );
+    return;
+}
+
+
+bool KICADMODULE::ReadCache( CACHE_READER& aCache,
+    const std::shared_ptr< const KICADFOOTPRINT >& aFootprint )
+{
+    int64_t side = aCache.GetInt();
+
+    if( side < LAYER_NONE || side > LAYER_EDGE || !aFootprint )
+    {
+        aCache.Invalidate();
+        return false;
+    }
+
+    m_side = (LAYERS) side;
+    m_refdes = aCache.GetString();
+    m_position = aCache.GetDoublet();
+    m_rotation = aCache.GetDouble();
+    m_footprint = aFootprint;
+
+    return aCache.IsOK();
+}
+
+
+bool KICADMODULE::parseModel( SEXPR::SEXPR* data, KICADFOOTPRINT* aFootprint )
 {
     KICADMODEL* mp = new KICADMODEL();
 
@@ -139,12 +348,13 @@ bool KICADMODULE::parseModel( SEXPR::SEXPR* data )
         return false;
     }
 
-    m_models.push_back( mp );
+    aFootprint->m_models.push_back( mp );
     return true;
 }
 
 
-bool KICADMODULE::parseCurve( SEXPR::SEXPR* data, CURVE_TYPE aCurveType )
+bool KICADMODULE::parseCurve( SEXPR::SEXPR* data, CURVE_TYPE aCurveType,
+    KICADFOOTPRINT* aFootprint )
 {
     KICADCURVE* mp = new KICADCURVE();
 
@@ -154,6 +364,19 @@ bool KICADMODULE::parseCurve( SEXPR::SEXPR* data, CURVE_TYPE aCurveType )
         return false;
     }
 
+    // glyphs on all layers contribute to the extent of the footprint
+    if( CURVE_LINE == mp->m_form )
+    {
+        aFootprint->m_bbox.Add( mp->m_start.x, mp->m_start.y );
+        aFootprint->m_bbox.Add( mp->m_end.x, mp->m_end.y );
+    }
+    else if( CURVE_NONE != mp->m_form )
+    {
+        double rad = std::hypot( mp->m_end.x - mp->m_start.x, mp->m_end.y - mp->m_start.y );
+        aFootprint->m_bbox.Add( BOX2D( mp->m_start.x - rad, mp->m_start.y - rad,
+            mp->m_start.x + rad, mp->m_start.y + rad ) );
+    }
+
     // NOTE: for now we are only interested in glyphs on the outline layer
     if( LAYER_EDGE != mp->GetLayer() )
     {
@@ -161,7 +384,7 @@ bool KICADMODULE::parseCurve( SEXPR::SEXPR* data, CURVE_TYPE aCurveType )
         return true;
     }
 
-    m_curves.push_back( mp );
+    aFootprint->m_curves.push_back( mp );
     return true;
 }
 
@@ -227,7 +450,7 @@ bool KICADMODULE::parseText( SEXPR::SEXPR* data )
 }
 
 
-bool KICADMODULE::parsePad( SEXPR::SEXPR* data )
+bool KICADMODULE::parsePad( SEXPR::SEXPR* data, KICADFOOTPRINT* aFootprint )
 {
     KICADPAD* mp = new KICADPAD();
 
@@ -237,21 +460,55 @@ bool KICADMODULE::parsePad( SEXPR::SEXPR* data )
         return false;
     }
 
-    // NOTE: for now we only accept thru-hole pads
-    // for the MCAD description
-    if( !mp->IsThruHole() )
+    // all pads contribute to the extent of the footprint; the
+    // circumscribed circle is used so the pad rotation is irrelevant
+    double rad = 0.5 * std::hypot( mp->m_size.x, mp->m_size.y );
+
+    if( mp->IsThruHole() )
+        rad = std::max( rad, 0.5 * std::max( mp->m_drill.size.x, mp->m_drill.size.y ) );
+
+    aFootprint->m_bbox.Add( BOX2D( mp->m_position.x - rad, mp->m_position.y - rad,
+        mp->m_position.x + rad, mp->m_position.y + rad ) );
+
+    // SMD pads are retained for the optional export of the pad copper
+    aFootprint->m_pads.push_back( mp );
+    return true;
+}
+
+
+bool KICADMODULE::GetBoundingBox( DOUBLET aOrigin, BOX2D& aBox ) const
+{
+    if( !m_footprint || m_footprint->m_bbox.IsEmpty() )
+        return false;
+
+    // transform the corners as the pads are transformed in ComposePCB()
+    const BOX2D& lbox = m_footprint->m_bbox;
+    double vsin = sin( m_rotation );
+    double vcos = cos( m_rotation );
+    double posX = m_position.x - aOrigin.x;
+    double posY = m_position.y - aOrigin.y;
+    double cx[4] = { lbox.minx, lbox.maxx, lbox.maxx, lbox.minx };
+    double cy[4] = { lbox.miny, lbox.miny, lbox.maxy, lbox.maxy };
+
+    aBox = BOX2D();
+
+    for( int i = 0; i < 4; ++i )
     {
-        delete mp;
-        return true;
+        double x = cx[i] * vcos + cy[i] * vsin;
+        double y = cx[i] * vsin - cy[i] * vcos;
+        aBox.Add( x + posX, y - posY );
     }
 
-    m_pads.push_back( mp );
     return true;
 }
 
 
-bool KICADMODULE::ComposePCB( class PCBMODEL* aPCB, S3D_FILENAME_RESOLVER* resolver, DOUBLET aOrigin )
+bool KICADMODULE::ComposePCB( class PCBMODEL* aPCB, S3D_FILENAME_RESOLVER* resolver, DOUBLET aOrigin,
+    PCB_STAGE* aStage, bool aComponents, bool aPadCopper )
 {
+    if( !m_footprint )
+        return false;
+
     // translate pads and curves to final position and append to PCB.
     double dlim = (double)std::numeric_limits< float >::epsilon();
 
@@ -262,7 +519,7 @@ bool KICADMODULE::ComposePCB( class PCBMODEL* aPCB, S3D_FILENAME_RESOLVER* resol
     double posX = m_position.x - aOrigin.x;
     double posY = m_position.y - aOrigin.y;
 
-    for( auto i : m_curves )
+    for( auto i : m_footprint->m_curves )
     {
         if( i->m_layer != LAYER_EDGE || CURVE_NONE == i->m_form )
             continue;
@@ -293,14 +550,20 @@ bool KICADMODULE::ComposePCB( class PCBMODEL* aPCB, S3D_FILENAME_RESOLVER* resol
         lcurve.m_end.x += posX;
         lcurve.m_end.y -= posY;
 
-        if( aPCB->AddOutlineSegment( &lcurve ) )
+        // rotated points are rounded to the nanometer grid as in KiCad
+        lcurve.m_nmStart = ToNM( lcurve.m_start );
+        lcurve.m_nmEnd = ToNM( lcurve.m_end );
+        lcurve.m_start = ToMM( lcurve.m_nmStart );
+        lcurve.m_end = ToMM( lcurve.m_nmEnd );
+
+        if( aPCB->AddOutlineSegment( &lcurve, aStage ) )
             hasdata = true;
 
     }
 
-    for( auto i : m_pads )
+    for( auto i : m_footprint->m_pads )
     {
-        if( !i->IsThruHole() )
+        if( !i->IsThruHole() && !aPadCopper )
             continue;
 
         KICADPAD lpad = *i;
@@ -317,19 +580,25 @@ bool KICADMODULE::ComposePCB( class PCBMODEL* aPCB, S3D_FILENAME_RESOLVER* resol
         lpad.m_position.x += posX;
         lpad.m_position.y -= posY;
 
-        if( aPCB->AddPadHole( &lpad ) )
+        if( lpad.IsThruHole() && aPCB->AddPadHole( &lpad, aStage ) )
+            hasdata = true;
+
+        if( aPadCopper && aPCB->AddPadCopper( &lpad, aStage ) )
             hasdata = true;
 
     }
 
+    if( !aComponents )
+        return hasdata;
+
     DOUBLET newpos( posX, posY );
 
-    for( auto i : m_models )
+    for( auto i : m_footprint->m_models )
     {
         std::string fname( resolver->ResolvePath( i->m_modelname.c_str() ).ToUTF8() );
 
         if( aPCB->AddComponent( fname, m_refdes, LAYER_BOTTOM == m_side ? true : false,
-            newpos, m_rotation, i->m_offset, i->m_rotation ) )
+            newpos, m_rotation, i->m_offset, i->m_rotation, aStage ) )
             hasdata = true;
 
     }
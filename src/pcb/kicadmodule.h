@@ -29,6 +29,8 @@
 #ifndef KICADMODULE_H
 #define KICADMODULE_H
 
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include "base.h"
@@ -38,38 +40,87 @@ namespace SEXPR
     class SEXPR;
 }
 
+class CACHE_READER;
+class CACHE_WRITER;
 class KICADPAD;
 class KICADCURVE;
 class KICADMODEL;
 class PCBMODEL;
 class S3D_FILENAME_RESOLVER;
+struct PCB_STAGE;
+
+/*
+ * The local geometry of a footprint (pads, outline glyphs and models).
+ * Boards typically place the same footprint many times so a definition
+ * is shared by all modules with identical local geometry; once parsed
+ * the definition is never modified.
+ */
+struct KICADFOOTPRINT
+{
+    KICADFOOTPRINT();
+    virtual ~KICADFOOTPRINT();
+
+    // store or restore the definition in a board cache
+    void WriteCache( CACHE_WRITER& aCache ) const;
+    bool ReadCache( CACHE_READER& aCache );
+
+    std::vector< KICADPAD* >    m_pads;
+    std::vector< KICADCURVE* >  m_curves;
+    std::vector< KICADMODEL* >  m_models;
+    BOX2D                       m_bbox;     // extent of all pads and glyphs (local coordinates)
+};
+
+// map of footprint content hashes to the shared footprint definitions
+typedef std::map< uint64_t, std::shared_ptr< const KICADFOOTPRINT > > FOOTPRINT_MAP;
 
 class KICADMODULE
 {
 private:
-    bool parseModel( SEXPR::SEXPR* data );
-    bool parseCurve( SEXPR::SEXPR* data, CURVE_TYPE aCurveType );
+    bool parseModel( SEXPR::SEXPR* data, KICADFOOTPRINT* aFootprint );
+    bool parseCurve( SEXPR::SEXPR* data, CURVE_TYPE aCurveType, KICADFOOTPRINT* aFootprint );
     bool parseLayer( SEXPR::SEXPR* data );
     bool parsePosition( SEXPR::SEXPR* data );
     bool parseText( SEXPR::SEXPR* data );
-    bool parsePad( SEXPR::SEXPR* data );
+    bool parsePad( SEXPR::SEXPR* data, KICADFOOTPRINT* aFootprint );
 
+    // per-instance data
     LAYERS      m_side;
     std::string m_refdes;
     DOUBLET     m_position;
     double      m_rotation; // rotation (radians)
 
-    std::vector< KICADPAD* >    m_pads;
-    std::vector< KICADCURVE* >  m_curves;
-    std::vector< KICADMODEL* >  m_models;
+    // shared footprint definition
+    std::shared_ptr< const KICADFOOTPRINT > m_footprint;
 
 public:
     KICADMODULE();
     virtual ~KICADMODULE();
 
-    bool Read( SEXPR::SEXPR* aEntry );
+    // read a module; if aFootprints is not NULL an existing definition with
+    // identical local geometry is shared and new definitions are added to the map
+    bool Read( SEXPR::SEXPR* aEntry, FOOTPRINT_MAP* aFootprints = NULL );
+
+    const KICADFOOTPRINT* GetFootprint() const
+    {
+        return m_footprint.get();
+    }
+
+    // store or restore the per-instance data in a board cache; the
+    // shared footprint definition is cached separately by the board
+    void WriteCache( CACHE_WRITER& aCache ) const;
+    bool ReadCache( CACHE_READER& aCache,
+        const std::shared_ptr< const KICADFOOTPRINT >& aFootprint );
+
+    // retrieve the extent of the placed footprint in the board model's
+    // coordinate system; returns false if the footprint has no extent
+    bool GetBoundingBox( DOUBLET aOrigin, BOX2D& aBox ) const;
 
-    bool ComposePCB( class PCBMODEL* aPCB, S3D_FILENAME_RESOLVER* resolver, DOUBLET aOrigin );
+    // add the module's outline segments, holes and models to aPCB; if aStage
+    // is not NULL the data is placed in the staging area instead; if
+    // aComponents is false the models are not added; if aPadCopper is true
+    // the copper of the pads on the outer layers is also added
+    bool ComposePCB( class PCBMODEL* aPCB, S3D_FILENAME_RESOLVER* resolver, DOUBLET aOrigin,
+        PCB_STAGE* aStage = NULL, bool aComponents = true, bool aPadCopper = false );
 };
 
 #endif  // KICADMODULE_H
@@ -26,6 +26,7 @@
 #include <sstream>
 #include "sexpr/sexpr.h"
 #include "kicadpad.h"
+#include "pcbcache.h"
 
 
 static const char bad_pad[] = "* corrupt module in PCB file; bad pad";
@@ -36,6 +37,10 @@ KICADPAD::KICADPAD()
     m_rotation = 0.0;
     m_thruhole = false;
     m_drill.oval = false;
+    m_shape = PAD_OTHER;
+    m_rratio = 0.0;
+    m_topCopper = false;
+    m_bottomCopper = false;
     return;
 }
 
@@ -48,8 +53,10 @@ KICADPAD::~KICADPAD()
 
 bool KICADPAD::Read( SEXPR::SEXPR* aEntry )
 {
-    // form: ( pad N thru_hole shape (at x y {r}) (size x y) (drill {oval} x {y}) (layers X X X) )
+    // form: ( pad N thru_hole shape (at x y {r}) (size x y) (drill {oval} x {y}) (layers X X X)
+    //         {(roundrect_rratio r)} )
     int nchild = aEntry->GetNumberOfChildren();
+    bool npth = false;
 
     if( nchild < 2 )
     {
@@ -69,6 +76,24 @@ bool KICADPAD::Read( SEXPR::SEXPR* aEntry )
             ( child->GetSymbol() == "thru_hole" || child->GetSymbol() == "np_thru_hole" ) )
         {
             m_thruhole = true;
+            npth = ( child->GetSymbol() == "np_thru_hole" );
+            continue;
+        }
+
+        // the pad number is child 1 and may itself be a symbol
+        if( i > 1 && child->IsSymbol() )
+        {
+            std::string shape = child->GetSymbol();
+
+            if( shape == "rect" )
+                m_shape = PAD_RECT;
+            else if( shape == "circle" )
+                m_shape = PAD_CIRCLE;
+            else if( shape == "oval" )
+                m_shape = PAD_OVAL;
+            else if( shape == "roundrect" )
+                m_shape = PAD_ROUNDRECT;
+
             continue;
         }
 
@@ -87,12 +112,72 @@ bool KICADPAD::Read( SEXPR::SEXPR* aEntry )
             {
                 ret = Get2DPositionAndRotation( child, m_position, m_rotation );
             }
+            else if( name == "size" )
+            {
+                ret = Get2DCoordinate( child, m_size );
+            }
+            else if( name == "layers" )
+            {
+                ret = parseLayers( child );
+            }
+            else if( name == "roundrect_rratio" && child->GetNumberOfChildren() > 1 )
+            {
+                SEXPR::SEXPR* ratio = child->GetChild( 1 );
+
+                if( ratio->IsDouble() )
+                    m_rratio = ratio->GetDouble();
+                else if( ratio->IsInteger() )
+                    m_rratio = (double) ratio->GetInteger();
+            }
 
             if( !ret )
                 return false;
         }
     }
 
+    // the copper of a non-plated hole is only nominal
+    if( npth )
+    {
+        m_topCopper = false;
+        m_bottomCopper = false;
+    }
+
+    return true;
+}
+
+
+bool KICADPAD::parseLayers( SEXPR::SEXPR* aLayers )
+{
+    // form: (layers X X X); only the outer copper layers are of interest
+    int nchild = aLayers->GetNumberOfChildren();
+
+    for( int i = 1; i < nchild; ++i )
+    {
+        SEXPR::SEXPR* child = aLayers->GetChild( i );
+        std::string layer;
+
+        if( child->IsSymbol() )
+            layer = child->GetSymbol();
+        else if( child->IsString() )
+            layer = child->GetString();
+        else
+            continue;
+
+        if( layer == "*.Cu" || layer == "F&B.Cu" )
+        {
+            m_topCopper = true;
+            m_bottomCopper = true;
+        }
+        else if( layer == "F.Cu" )
+        {
+            m_topCopper = true;
+        }
+        else if( layer == "B.Cu" )
+        {
+            m_bottomCopper = true;
+        }
+    }
+
     return true;
 }
 
@@ -181,3 +266,42 @@ bool KICADPAD::parseDrill( SEXPR::SEXPR* aDrill )
 
     return true;
 }
+
+
+void KICADPAD::WriteCache( CACHE_WRITER& aCache ) const
+{
+    aCache.PutBool( m_thruhole );
+    aCache.PutDoublet( m_position );
+    aCache.PutDouble( m_rotation );
+    aCache.PutDoublet( m_size );
+    aCache.PutDoublet( m_drill.size );
+    aCache.PutBool( m_drill.oval );
+    aCache.PutInt( (int64_t) m_shape );
+    aCache.PutDouble( m_rratio );
+    aCache.PutBool( m_topCopper );
+    aCache.PutBool( m_bottomCopper );
+    return;
+}
+
+
+bool KICADPAD::ReadCache( CACHE_READER& aCache )
+{
+    m_thruhole = aCache.GetBool();
+    m_position = aCache.GetDoublet();
+    m_rotation = aCache.GetDouble();
+    m_size = aCache.GetDoublet();
+    m_drill.size = aCache.GetDoublet();
+    m_drill.oval = aCache.GetBool();
+
+    int64_t shape = aCache.GetInt();
+
+    if( shape < PAD_RECT || shape > PAD_OTHER )
+        shape = PAD_OTHER;
+
+    m_shape = (PAD_SHAPE) shape;
+    m_rratio = aCache.GetDouble();
+    m_topCopper = aCache.GetBool();
+    m_bottomCopper = aCache.GetBool();
+
+    return aCache.IsOK();
+}
@@ -33,6 +33,20 @@
 #include <vector>
 #include "base.h"
 
+class CACHE_READER;
+class CACHE_WRITER;
+
+
+// form of the copper of a pad
+enum PAD_SHAPE
+{
+    PAD_RECT,
+    PAD_CIRCLE,
+    PAD_OVAL,
+    PAD_ROUNDRECT,
+    PAD_OTHER       // trapezoid or custom; the copper is not exported
+};
+
 
 struct KICADDRILL
 {
@@ -46,6 +60,7 @@ class KICADPAD
 private:
     bool        m_thruhole;
     bool parseDrill( SEXPR::SEXPR* aDrill );
+    bool parseLayers( SEXPR::SEXPR* aLayers );
 
 public:
     KICADPAD();
@@ -53,6 +68,10 @@ public:
 
     bool Read( SEXPR::SEXPR* aEntry );
 
+    // store or restore the parsed data in a board cache
+    void WriteCache( CACHE_WRITER& aCache ) const;
+    bool ReadCache( CACHE_READER& aCache );
+
     bool IsThruHole()
     {
         return m_thruhole;
@@ -60,7 +79,12 @@ public:
 
     DOUBLET     m_position;
     double      m_rotation; // rotation (radians)
+    DOUBLET     m_size;     // size of the copper pad
     KICADDRILL  m_drill;
+    PAD_SHAPE   m_shape;
+    double      m_rratio;   // corner radius of a roundrect pad relative to the smaller side
+    bool        m_topCopper;    // set true if the pad has copper on F.Cu
+    bool        m_bottomCopper; // set true if the pad has copper on B.Cu
 };
 
 #endif  // KICADPAD_H
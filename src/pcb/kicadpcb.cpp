@@ -22,10 +22,16 @@
  */
 
 #include <wx/utils.h>
+#include <wx/filefn.h>
 #include <wx/filename.h>
 #include <wx/log.h>
 #include <wx/stdpaths.h>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <string>
 
@@ -34,7 +40,16 @@
 #include "sexpr/sexpr_parser.h"
 #include "kicadmodule.h"
 #include "kicadcurve.h"
+#include "kicadmodel.h"
 #include "oce_utils.h"
+#include "pcbcache.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "rtree.h"
+#include "geom2d.h"
+
+// maximum deviation (mm) of the exported copper from the true track profiles
+#define COPPER_DEVIATION (0.005)
 
 
 /*
@@ -81,11 +96,24 @@ static wxString GetKicadConfigPath()
 
 KICADPCB::KICADPCB()
 {
-    wxFileName cfgdir( GetKicadConfigPath(), "" );
-    cfgdir.AppendDir( "3d" );
-    m_resolver.Set3DConfigDir( cfgdir.GetPath() );
+    m_resolverReady = false;
+    m_boardOnly = false;
     m_thickness = 1.6;
+    m_viaDrill = 0.0;
     m_pcb = NULL;
+    m_system = NULL;
+    m_threads = 0;
+    m_tileSize = 0.0;
+    m_simplify = 0.0;
+    m_useCache = false;
+    m_modelCache = NULL;
+    m_profiler = NULL;
+    m_viaHoles = false;
+    m_tracks = false;
+    m_zones = false;
+    m_pads = false;
+    m_rail = 0.0;
+    m_tab = 0.0;
 
     return;
 }
@@ -93,15 +121,109 @@ KICADPCB::KICADPCB()
 
 KICADPCB::~KICADPCB()
 {
-    for( auto i : m_modules )
-        delete i;
+    clearData();
 
-    for( auto i : m_curves )
-        delete i;
+    if( m_pcb )
+        delete m_pcb;
+
+    if( m_modelCache )
+        delete m_modelCache;
+
+    return;
+}
+
+
+// the boards of an assembly are read on worker threads; the KiCad
+// configuration is shared by all boards while KIPRJMOD is kept by
+// each board's resolver
+static std::mutex s_resolverLock;
+
+
+void KICADPCB::initResolver( const wxString& aProjectDir )
+{
+    std::lock_guard< std::mutex > lock( s_resolverLock );
+
+    if( !m_resolverReady )
+    {
+        wxFileName cfgdir( GetKicadConfigPath(), "" );
+        cfgdir.AppendDir( "3d" );
+        m_resolver.Set3DConfigDir( cfgdir.GetPath() );
+        m_resolverReady = true;
+    }
+
+    if( !aProjectDir.empty() )
+        m_resolver.SetProjectDir( aProjectDir );
+
+    return;
+}
+
+
+void KICADPCB::EnableModelCache()
+{
+    if( NULL == m_modelCache )
+        m_modelCache = new MODEL_CACHE;
+
+    return;
+}
+
+
+void KICADPCB::GetSourceFiles( std::vector< std::string >& aFileNames ) const
+{
+    aFileNames.clear();
 
+    if( m_modelCache )
+        m_modelCache->GetFileNames( aFileNames );
+
+    if( !m_filename.empty() )
+        aFileNames.insert( aFileNames.begin(), m_filename );
+
+    return;
+}
+
+
+void KICADPCB::GetModelFiles( std::vector< std::string >& aFileNames )
+{
+    std::set< std::string > names;
+
+    // a bare board does not depend on the models
+    if( m_boardOnly )
+    {
+        aFileNames.clear();
+        return;
+    }
+
+    initResolver( wxEmptyString );
+
+    for( auto& i : m_footprints )
+    {
+        for( auto j : i.second->m_models )
+            names.insert( j->m_modelname );
+    }
+
+    aFileNames.clear();
+
+    for( auto& i : names )
+        aFileNames.push_back( std::string( m_resolver.ResolvePath( i.c_str() ).ToUTF8() ) );
+
+    return;
+}
+
+
+void KICADPCB::ModelChanged( const std::string& aFileName )
+{
+    if( m_modelCache )
+        m_modelCache->Remove( aFileName );
+
+    return;
+}
+
+
+void KICADPCB::ReleaseModel()
+{
     if( m_pcb )
         delete m_pcb;
 
+    m_pcb = NULL;
     return;
 }
 
@@ -131,17 +253,36 @@ bool KICADPCB::ReadFile( const wxString& aFileName )
         return false;
     }
 
+    // discard the data of any previously read board
+    ReleaseModel();
+    clearData();
+
     fname.Normalize();
     m_filename = fname.GetFullPath().ToUTF8();
-    m_resolver.SetProjectDir( fname.GetPath() );
+
+    // the model paths are not needed for the bare board
+    if( !m_boardOnly )
+        initResolver( fname.GetPath() );
+
+    uint64_t hash = 0;
+    std::string cachename;
 
     try
     {
+        if( m_useCache && HashFile( m_filename, hash ) )
+        {
+            cachename = getCacheName();
+
+            if( readCache( cachename, hash ) )
+                return true;
+        }
+
         SEXPR::PARSER parser;
         std::string infile( fname.GetFullPath().ToUTF8() );
-        SEXPR::SEXPR* data = parser.ParseFromFile( infile );
+        // the tree is released as soon as the board data has been extracted
+        std::unique_ptr< SEXPR::SEXPR > data( parser.ParseFromFile( infile ) );
 
-        if( NULL == data )
+        if( !data )
         {
             std::ostringstream ostr;
             ostr << "* no data in file: '" << aFileName.ToUTF8() << "'\n";
@@ -150,9 +291,14 @@ bool KICADPCB::ReadFile( const wxString& aFileName )
             return false;
         }
 
-        if( !parsePCB( data ) )
+        if( !parsePCB( data.get() ) )
             return false;
 
+        data.reset();
+
+        if( !cachename.empty() )
+            writeCache( cachename, hash );
+
     }
     catch( std::exception& e )
     {
@@ -176,6 +322,288 @@ bool KICADPCB::ReadFile( const wxString& aFileName )
 }
 
 
+void KICADPCB::clearData()
+{
+    for( auto i : m_modules )
+        delete i;
+
+    for( auto i : m_curves )
+        delete i;
+
+    m_modules.clear();
+    m_curves.clear();
+    m_vias.clear();
+    m_trackList.clear();
+    m_fills.clear();
+    m_footprints.clear();
+    m_keepouts.clear();
+    m_viaDrill = 0.0;
+    m_netNames.clear();
+    m_netViaDrills.clear();
+
+    return;
+}
+
+
+std::string KICADPCB::getCacheName() const
+{
+    wxFileName fname( wxString::FromUTF8( m_filename.c_str() ) );
+    wxFileName cname;
+
+    if( m_cacheDir.empty() )
+    {
+        cname.Assign( fname.GetPath(), fname.GetName(), "k2mc" );
+    }
+    else
+    {
+        // boards in different directories may share a name so the
+        // cache name includes a hash of the full path
+        std::ostringstream ostr;
+        ostr << fname.GetName().ToUTF8() << "-" << std::hex;
+        ostr << HashBytes( m_filename.data(), m_filename.size() );
+        cname.Assign( wxString::FromUTF8( m_cacheDir.c_str() ),
+            wxString::FromUTF8( ostr.str().c_str() ), "k2mc" );
+    }
+
+    return std::string( cname.GetFullPath().ToUTF8() );
+}
+
+
+bool KICADPCB::readCache( const std::string& aCacheName, uint64_t aHash )
+{
+    CACHE_READER cache;
+
+    if( !wxFileName::FileExists( wxString::FromUTF8( aCacheName.c_str() ) )
+        || !cache.Open( aCacheName ) )
+        return false;
+
+    if( cache.GetInt() != CACHE_MAGIC || cache.GetInt() != CACHE_VERSION
+        || cache.GetInt() != CACHE_BYTE_ORDER || cache.GetInt() != (int64_t) aHash )
+        return false;
+
+    // the tracks and zone fills are only parsed if they are exported;
+    // a cache written without them is replaced when they are requested
+    bool hasTracks = cache.GetBool();
+    bool hasZones = cache.GetBool();
+
+    if( !cache.IsOK() || ( m_tracks && !hasTracks ) || ( m_zones && !hasZones ) )
+        return false;
+
+    clearData();
+    m_thickness = cache.GetDouble();
+
+    int64_t n = cache.GetInt();
+
+    for( int64_t i = 0; i < n && cache.IsOK(); ++i )
+    {
+        KICADCURVE* mp = new KICADCURVE();
+        m_curves.push_back( mp );
+
+        if( !mp->ReadCache( cache ) )
+        {
+            cache.Invalidate();
+            break;
+        }
+    }
+
+    n = cache.GetInt();
+
+    // the records are appended one at a time so that a corrupt count
+    // ends at the end of the file rather than in a huge allocation
+    for( int64_t i = 0; i < n && cache.IsOK(); ++i )
+    {
+        m_vias.emplace_back();
+
+        if( !m_vias.back().ReadCache( cache ) )
+        {
+            cache.Invalidate();
+            break;
+        }
+    }
+
+    n = cache.GetInt();
+
+    for( int64_t i = 0; i < n && cache.IsOK(); ++i )
+    {
+        m_trackList.emplace_back();
+
+        if( !m_trackList.back().ReadCache( cache ) )
+        {
+            cache.Invalidate();
+            break;
+        }
+    }
+
+    n = cache.GetInt();
+
+    for( int64_t i = 0; i < n && cache.IsOK(); ++i )
+    {
+        m_fills.emplace_back();
+
+        if( !m_fills.back().ReadCache( cache ) )
+        {
+            cache.Invalidate();
+            break;
+        }
+    }
+
+    n = cache.GetInt();
+
+    for( int64_t i = 0; i < n && cache.IsOK(); ++i )
+    {
+        std::string name = cache.GetString();
+        m_keepouts[name] = cache.GetBox();
+    }
+
+    // footprint definitions are stored once and referenced by index
+    std::vector< std::shared_ptr< const KICADFOOTPRINT > > footprints;
+    n = cache.GetInt();
+
+    for( int64_t i = 0; i < n && cache.IsOK(); ++i )
+    {
+        uint64_t key = (uint64_t) cache.GetInt();
+        KICADFOOTPRINT* fp = new KICADFOOTPRINT();
+        footprints.push_back( std::shared_ptr< const KICADFOOTPRINT >( fp ) );
+
+        if( !fp->ReadCache( cache ) )
+        {
+            cache.Invalidate();
+            break;
+        }
+
+        m_footprints.insert( std::make_pair( key, footprints.back() ) );
+    }
+
+    n = cache.GetInt();
+
+    for( int64_t i = 0; i < n && cache.IsOK(); ++i )
+    {
+        int64_t idx = cache.GetInt();
+
+        if( idx < 0 || idx >= (int64_t) footprints.size() )
+        {
+            cache.Invalidate();
+            break;
+        }
+
+        KICADMODULE* mp = new KICADMODULE();
+        m_modules.push_back( mp );
+
+        if( !mp->ReadCache( cache, footprints[idx] ) )
+        {
+            cache.Invalidate();
+            break;
+        }
+    }
+
+    if( !cache.IsOK() || (int64_t) m_modules.size() != n )
+    {
+        std::ostringstream ostr;
+        ostr << "* corrupt board cache: '" << aCacheName << "'; reading the PCB file\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        clearData();
+        return false;
+    }
+
+    return true;
+}
+
+
+bool KICADPCB::writeCache( const std::string& aCacheName, uint64_t aHash )
+{
+    // the cache is written to a temporary file and renamed so that
+    // concurrent readers never see a partially written cache
+    std::string tmpname = aCacheName + ".tmp";
+    CACHE_WRITER cache;
+
+    if( !cache.Open( tmpname ) )
+    {
+        std::ostringstream ostr;
+        ostr << "* could not create board cache: '" << tmpname << "'\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    cache.PutInt( CACHE_MAGIC );
+    cache.PutInt( CACHE_VERSION );
+    cache.PutInt( CACHE_BYTE_ORDER );
+    cache.PutInt( (int64_t) aHash );
+    cache.PutBool( m_tracks );
+    cache.PutBool( m_zones );
+    cache.PutDouble( m_thickness );
+
+    cache.PutInt( (int64_t) m_curves.size() );
+
+    for( auto i : m_curves )
+        i->WriteCache( cache );
+
+    cache.PutInt( (int64_t) m_vias.size() );
+
+    for( auto& i : m_vias )
+        i.WriteCache( cache );
+
+    cache.PutInt( (int64_t) m_trackList.size() );
+
+    for( auto& i : m_trackList )
+        i.WriteCache( cache );
+
+    cache.PutInt( (int64_t) m_fills.size() );
+
+    for( auto& i : m_fills )
+        i.WriteCache( cache );
+
+    cache.PutInt( (int64_t) m_keepouts.size() );
+
+    for( auto& i : m_keepouts )
+    {
+        cache.PutString( i.first );
+        cache.PutBox( i.second );
+    }
+
+    std::map< const KICADFOOTPRINT*, int64_t > index;
+    cache.PutInt( (int64_t) m_footprints.size() );
+
+    for( auto& i : m_footprints )
+    {
+        int64_t idx = (int64_t) index.size();
+        index[i.second.get()] = idx;
+        cache.PutInt( (int64_t) i.first );
+        i.second->WriteCache( cache );
+    }
+
+    cache.PutInt( (int64_t) m_modules.size() );
+
+    for( auto i : m_modules )
+    {
+        cache.PutInt( index[i->GetFootprint()] );
+        i->WriteCache( cache );
+    }
+
+    bool ok = cache.Close();
+    wxString wtmp = wxString::FromUTF8( tmpname.c_str() );
+
+    if( !ok || !wxRenameFile( wtmp, wxString::FromUTF8( aCacheName.c_str() ), true ) )
+    {
+        wxRemoveFile( wtmp );
+        std::ostringstream ostr;
+        ostr << "* could not write board cache: '" << aCacheName << "'\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+
+bool KICADPCB::CheckShapes()
+{
+    if( m_pcb )
+        return m_pcb->CheckShapes();
+
+    return false;
+}
+
+
 bool KICADPCB::WriteSTEP( const wxString& aFileName, bool aOverwrite )
 {
     if( m_pcb )
@@ -239,6 +667,12 @@ bool KICADPCB::parsePCB( SEXPR::SEXPR* data )
 
             if( symname == "general" )
                 result = result && parseGeneral( child );
+            else if( symname == "setup" )
+                result = result && parseSetup( child );
+            else if( symname == "net" )
+                result = result && parseNet( child );
+            else if( symname == "net_class" )
+                result = result && parseNetClass( child );
             else if( symname == "module" )
                 result = result && parseModule( child );
             else if( symname == "gr_arc" )
@@ -247,8 +681,19 @@ bool KICADPCB::parsePCB( SEXPR::SEXPR* data )
                 result = result && parseCurve( child, CURVE_LINE );
             else if( symname == "gr_circle" )
                 result = result && parseCurve( child, CURVE_CIRCLE );
+            else if( symname == "zone" )
+                result = result && parseZone( child );
+            else if( symname == "via" )
+                result = result && parseVia( child );
+            else if( symname == "segment" && m_tracks )
+                result = result && parseTrack( child, false );
+            else if( symname == "arc" && m_tracks )
+                result = result && parseTrack( child, true );
         }
 
+        if( result )
+            setViaDrills();
+
         return result;
     }
 
@@ -299,7 +744,7 @@ bool KICADPCB::parseModule( SEXPR::SEXPR* data )
 {
     KICADMODULE* mp = new KICADMODULE();
 
-    if( !mp->Read( data ) )
+    if( !mp->Read( data, &m_footprints ) )
     {
         delete mp;
         return false;
@@ -332,43 +777,761 @@ bool KICADPCB::parseCurve( SEXPR::SEXPR* data, CURVE_TYPE aCurveType )
 }
 
 
-bool KICADPCB::ComposePCB()
+// retrieve a numeric atom; KiCad writes whole numbers as integers
+static bool getNumber( SEXPR::SEXPR* aAtom, double& aValue )
 {
-    if( m_pcb )
-        return true;
+    if( aAtom->IsDouble() )
+        aValue = aAtom->GetDouble();
+    else if( aAtom->IsInteger() )
+        aValue = (double) aAtom->GetInteger();
+    else
+        return false;
 
-    if( m_modules.empty() && m_curves.empty() )
-    {
-        std::ostringstream ostr;
-        ostr << "** " << __FILE__ << ":" << __FUNCTION__ << ":" << __LINE__ << "\n";
-        ostr << "*  no PCB data to render\n";
-        wxLogMessage( "%s\n", ostr.str().c_str() );
+    return true;
+}
+
+
+// retrieve the text of a string or symbol atom
+static bool getName( SEXPR::SEXPR* aAtom, std::string& aName )
+{
+    if( aAtom->IsString() )
+        aName = aAtom->GetString();
+    else if( aAtom->IsSymbol() )
+        aName = aAtom->GetSymbol();
+    else
         return false;
-    }
 
-    m_pcb = new PCBMODEL();
-    m_pcb->SetPCBThickness( m_thickness );
+    return true;
+}
 
-    for( auto i : m_curves )
+
+bool KICADPCB::parseSetup( SEXPR::SEXPR* data )
+{
+    size_t nc = data->GetNumberOfChildren();
+
+    for( size_t i = 1; i < nc; ++i )
     {
-        if( CURVE_NONE == i->m_form || LAYER_EDGE != i->m_layer )
+        SEXPR::SEXPR* child = data->GetChild( i );
+
+        // only the default via drill is of interest in the setup section
+        if( !child->IsList() || child->GetNumberOfChildren() < 2
+            || child->GetChild( 0 )->GetSymbol() != "via_drill" )
             continue;
 
-        // adjust the coordinate system
-        KICADCURVE lcurve = *i;
-        lcurve.m_start.y = -( lcurve.m_start.y - m_origin.y );
-        lcurve.m_end.y = -( lcurve.m_end.y - m_origin.y );
-        lcurve.m_start.x -= m_origin.x;
-        lcurve.m_end.x -= m_origin.x;
+        getNumber( child->GetChild( 1 ), m_viaDrill );
+    }
 
-        if( CURVE_ARC == lcurve.m_form )
-            lcurve.m_angle = -lcurve.m_angle;
+    return true;
+}
 
-        m_pcb->AddOutlineSegment( &lcurve );
-    }
 
-    for( auto i : m_modules )
-        i->ComposePCB( m_pcb, &m_resolver, m_origin );
+bool KICADPCB::parseNet( SEXPR::SEXPR* data )
+{
+    // form: ( net N "name" )
+    std::string name;
+
+    if( data->GetNumberOfChildren() < 3 || !data->GetChild( 1 )->IsInteger()
+        || !getName( data->GetChild( 2 ), name ) )
+        return true;
+
+    m_netNames[data->GetChild( 1 )->GetInteger()] = name;
+    return true;
+}
+
+
+bool KICADPCB::parseNetClass( SEXPR::SEXPR* data )
+{
+    // form: ( net_class name "description" ... (via_drill d) ... (add_net name) ... )
+    size_t nc = data->GetNumberOfChildren();
+    std::vector< std::string > nets;
+    double drill = 0.0;
+    std::string name;
+
+    if( nc < 2 || !getName( data->GetChild( 1 ), name ) )
+        return true;
+
+    for( size_t i = 2; i < nc; ++i )
+    {
+        SEXPR::SEXPR* child = data->GetChild( i );
+
+        if( !child->IsList() || child->GetNumberOfChildren() < 2 )
+            continue;
+
+        std::string sym( child->GetChild( 0 )->GetSymbol() );
+        std::string net;
+
+        if( sym == "via_drill" )
+            getNumber( child->GetChild( 1 ), drill );
+        else if( sym == "add_net" && getName( child->GetChild( 1 ), net ) )
+            nets.push_back( net );
+    }
+
+    if( drill <= 0.0 )
+        return true;
+
+    // the default class applies to all nets which are not in another class
+    if( name == "Default" )
+        m_viaDrill = drill;
+
+    for( auto& i : nets )
+        m_netViaDrills[i] = drill;
+
+    return true;
+}
+
+
+void KICADPCB::setViaDrills()
+{
+    for( auto& i : m_vias )
+    {
+        if( i.m_drill > 0.0 )
+            continue;
+
+        i.m_drill = m_viaDrill;
+        std::map< int, std::string >::const_iterator net = m_netNames.find( i.m_net );
+
+        if( net == m_netNames.end() )
+            continue;
+
+        std::map< std::string, double >::const_iterator drill = m_netViaDrills.find( net->second );
+
+        if( drill != m_netViaDrills.end() )
+            i.m_drill = drill->second;
+    }
+
+    return;
+}
+
+
+bool KICADPCB::parseVia( SEXPR::SEXPR* data )
+{
+    KICADVIA via;
+
+    if( !via.Read( data ) )
+        return false;
+
+    m_vias.push_back( via );
+    return true;
+}
+
+
+bool KICADPCB::parseTrack( SEXPR::SEXPR* data, bool aArc )
+{
+    KICADTRACK track;
+
+    if( !track.Read( data, aArc ) )
+        return false;
+
+    // reject any tracks on the inner layers
+    if( LAYER_NONE == track.m_layer )
+        return true;
+
+    m_trackList.push_back( track );
+    return true;
+}
+
+
+void KICADPCB::addViaHoles()
+{
+    PROFILE_SCOPE timer( m_profiler, "via holes" );
+
+    // the vias are placed in blocks on the worker threads; each block has
+    // its own staging area and the blocks are committed in file order
+    const size_t blockSize = 4096;
+    size_t nBlocks = ( m_vias.size() + blockSize - 1 ) / blockSize;
+    std::vector< PCB_STAGE > stages( nBlocks );
+    std::vector< size_t > nBlind( nBlocks, 0 );
+    std::vector< size_t > nNoDrill( nBlocks, 0 );
+    NMPOINT origin = ToNM( m_origin );
+
+    ParallelFor( nBlocks, m_threads, [&]( size_t aBlock )
+        {
+            size_t last = std::min( ( aBlock + 1 ) * blockSize, m_vias.size() );
+
+            for( size_t i = aBlock * blockSize; i < last; ++i )
+            {
+                if( !m_vias[i].IsThruHole() )
+                {
+                    ++nBlind[aBlock];
+                    continue;
+                }
+
+                // the drill was neither given nor found in the net classes
+                if( m_vias[i].m_drill <= 0.0 )
+                {
+                    ++nNoDrill[aBlock];
+                    continue;
+                }
+
+                // adjust the coordinate system as for the board level curves
+                NMPOINT pos = ToNM( m_vias[i].m_position );
+                pos.x -= origin.x;
+                pos.y = -( pos.y - origin.y );
+                m_pcb->AddViaHole( ToMM( pos ), m_vias[i].m_drill, &stages[aBlock] );
+            }
+        } );
+
+    wxLog::FlushActive();
+
+    size_t nSkipped = 0;
+    size_t nUndrilled = 0;
+
+    for( size_t i = 0; i < nBlocks; ++i )
+    {
+        m_pcb->CommitStage( stages[i] );
+        nSkipped += nBlind[i];
+        nUndrilled += nNoDrill[i];
+    }
+
+    if( nUndrilled > 0 )
+    {
+        std::ostringstream ostr;
+        ostr << "* " << nUndrilled << " vias without a drill size in the board file ";
+        ostr << "or its net classes were ignored\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+    }
+
+    if( nSkipped > 0 )
+    {
+        std::ostringstream ostr;
+        ostr << "* " << nSkipped << " blind or micro vias do not pass through the board ";
+        ostr << "and were ignored\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+    }
+
+    return;
+}
+
+
+void KICADPCB::addTracks( const BOX2D& aRegion )
+{
+    PROFILE_SCOPE timer( m_profiler, "tracks" );
+
+    // tracks only merge with tracks of the same net on the same layer
+    typedef std::pair< int, int > TRACK_GROUP;  // layer and net
+    std::map< TRACK_GROUP, std::vector< size_t > > groups;
+
+    for( size_t i = 0; i < m_trackList.size(); ++i )
+    {
+        const KICADTRACK& track = m_trackList[i];
+        groups[TRACK_GROUP( (int) track.m_layer, track.m_net )].push_back( i );
+    }
+
+    std::vector< std::pair< TRACK_GROUP, std::vector< size_t > > > groupList(
+        groups.begin(), groups.end() );
+    std::vector< std::vector< POLYGON_REGION > > regions( groupList.size() );
+    std::vector< char > merged( groupList.size(), 1 );
+    NMPOINT origin = ToNM( m_origin );
+
+    // adjust the coordinate system as for the board level curves
+    auto toBoard = [&]( const NMPOINT& aPoint )
+    {
+        return ToMM( NMPOINT( aPoint.x - origin.x, -( aPoint.y - origin.y ) ) );
+    };
+
+    ParallelFor( groupList.size(), m_threads, [&]( size_t aGroup )
+        {
+            std::vector< std::vector< DOUBLET > > polygons;
+
+            for( auto idx : groupList[aGroup].second )
+            {
+                const KICADTRACK& track = m_trackList[idx];
+                double rad = 0.5 * track.m_width;
+                std::vector< DOUBLET > points;
+                points.push_back( toBoard( track.m_start ) );
+
+                DOUBLET center;
+                DOUBLET mid = toBoard( track.m_mid );
+                DOUBLET end = toBoard( track.m_end );
+
+                // an arc is followed by chords which are merged like segments
+                if( track.m_arc && CircleCenter( points[0], mid, end, center ) )
+                {
+                    double radius = std::hypot( points[0].x - center.x, points[0].y - center.y );
+                    double a0 = std::atan2( points[0].y - center.y, points[0].x - center.x );
+                    double a1 = std::atan2( end.y - center.y, end.x - center.x );
+                    bool ccw = ( mid.x - points[0].x ) * ( end.y - points[0].y )
+                        - ( mid.y - points[0].y ) * ( end.x - points[0].x ) > 0.0;
+                    double sweep = a1 - a0;
+
+                    if( ccw && sweep < 0.0 )
+                        sweep += 2.0 * M_PI;
+                    else if( !ccw && sweep > 0.0 )
+                        sweep -= 2.0 * M_PI;
+
+                    int ns = ArcSegments( radius, sweep, COPPER_DEVIATION );
+
+                    for( int i = 1; i < ns; ++i )
+                    {
+                        double ang = a0 + sweep * i / ns;
+                        points.push_back( DOUBLET( center.x + radius * std::cos( ang ),
+                            center.y + radius * std::sin( ang ) ) );
+                    }
+                }
+
+                points.push_back( end );
+
+                for( size_t i = 1; i < points.size(); ++i )
+                {
+                    if( !aRegion.IsEmpty() )
+                    {
+                        BOX2D box( points[i - 1].x, points[i - 1].y, points[i].x, points[i].y );
+                        box.Inflate( rad );
+
+                        if( !box.Intersects( aRegion ) )
+                            continue;
+                    }
+
+                    polygons.push_back( std::vector< DOUBLET >() );
+                    StadiumPolygon( points[i - 1], points[i], rad, COPPER_DEVIATION,
+                        polygons.back() );
+                }
+            }
+
+            if( !PolygonUnion( polygons, regions[aGroup] ) )
+                merged[aGroup] = 0;
+        } );
+
+    wxLog::FlushActive();
+
+    size_t nRegions = 0;
+
+    for( size_t i = 0; i < groupList.size(); ++i )
+    {
+        if( !merged[i] )
+        {
+            std::ostringstream ostr;
+            ostr << "* some tracks of net " << groupList[i].first.second << " on ";
+            ostr << ( LAYER_BOTTOM == groupList[i].first.first ? "B.Cu" : "F.Cu" );
+            ostr << " could not be merged and were omitted\n";
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+        }
+
+        for( auto& j : regions[i] )
+        {
+            if( m_pcb->AddCopper( j, LAYER_BOTTOM == groupList[i].first.first ) )
+                ++nRegions;
+        }
+    }
+
+    std::ostringstream ostr;
+    ostr << "* merged " << m_trackList.size() << " tracks into " << nRegions << " copper regions\n";
+    wxLogMessage( "%s\n", ostr.str().c_str() );
+
+    return;
+}
+
+
+// the outer copper layer named by aLayer; LAYER_NONE for any other layer
+static LAYERS getCopperLayer( SEXPR::SEXPR* aLayer )
+{
+    std::string name;
+
+    if( aLayer->IsSymbol() )
+        name = aLayer->GetSymbol();
+    else if( aLayer->IsString() )
+        name = aLayer->GetString();
+
+    if( name == "F.Cu" )
+        return LAYER_TOP;
+
+    if( name == "B.Cu" )
+        return LAYER_BOTTOM;
+
+    return LAYER_NONE;
+}
+
+
+void KICADPCB::addZones( const BOX2D& aRegion )
+{
+    PROFILE_SCOPE timer( m_profiler, "zones" );
+
+    // the fills are processed in blocks; the regions and solids of each block
+    // are built before the next block is converted and the points of the
+    // fills are released as they are used
+    const size_t blockSize = 64;
+    NMPOINT origin = ToNM( m_origin );
+    size_t nRegions = 0;
+    size_t nFailed = 0;
+
+    for( size_t base = 0; base < m_fills.size(); base += blockSize )
+    {
+        size_t count = std::min( blockSize, m_fills.size() - base );
+        std::vector< std::vector< POLYGON_REGION > > regions( count );
+        std::vector< char > ok( count, 1 );
+
+        ParallelFor( count, m_threads, [&]( size_t aIndex )
+            {
+                const KICADZONEFILL& fill = m_fills[base + aIndex];
+                std::vector< DOUBLET > polygon;
+                polygon.reserve( fill.m_points.size() );
+                BOX2D box;
+
+                // adjust the coordinate system as for the board level curves
+                for( const auto& i : fill.m_points )
+                {
+                    polygon.push_back( ToMM( NMPOINT( i.x - origin.x, -( i.y - origin.y ) ) ) );
+                    box.Add( polygon.back().x, polygon.back().y );
+                }
+
+                if( !aRegion.IsEmpty() && !box.Intersects( aRegion ) )
+                    return;
+
+                if( !UnfracturePolygon( polygon, regions[aIndex] ) )
+                    ok[aIndex] = 0;
+            } );
+
+        for( size_t i = 0; i < count; ++i )
+        {
+            if( !ok[i] )
+                ++nFailed;
+
+            for( auto& j : regions[i] )
+            {
+                if( m_pcb->AddCopper( j, LAYER_BOTTOM == m_fills[base + i].m_layer ) )
+                    ++nRegions;
+            }
+
+            std::vector< POLYGON_REGION >().swap( regions[i] );
+
+            // the fills are only needed again if the board is composed repeatedly
+            if( NULL == m_modelCache )
+                std::vector< NMPOINT >().swap( m_fills[base + i].m_points );
+        }
+
+        // the solids are built block by block so that the points
+        // of only one block of regions are held at a time
+        m_pcb->BuildCopper();
+    }
+
+    wxLog::FlushActive();
+
+    if( nFailed > 0 )
+    {
+        std::ostringstream ostr;
+        ostr << "* " << nFailed << " zone fills could not be fully converted; ";
+        ostr << "the open parts were omitted\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+    }
+
+    std::ostringstream ostr;
+    ostr << "* converted " << m_fills.size() << " zone fills into " << nRegions;
+    ostr << " copper regions\n";
+    wxLogMessage( "%s\n", ostr.str().c_str() );
+
+    return;
+}
+
+
+bool KICADPCB::parseZone( SEXPR::SEXPR* data )
+{
+    // the name and extent of keepout zones are retained; the name is taken
+    // from the 'name' attribute or, failing that, the net name. The filled
+    // areas of copper zones on the outer layers are also retained
+    size_t nc = data->GetNumberOfChildren();
+    bool keepout = false;
+    std::string name;
+    std::string netname;
+    BOX2D bbox;
+    LAYERS layer = LAYER_NONE;
+    int net = 0;
+
+    for( size_t i = 1; i < nc; ++i )
+    {
+        SEXPR::SEXPR* child = data->GetChild( i );
+
+        if( !child->IsList() || child->GetNumberOfChildren() < 1
+            || !child->GetChild( 0 )->IsSymbol() )
+            continue;
+
+        std::string symname( child->GetChild( 0 )->GetSymbol() );
+
+        if( symname == "keepout" )
+        {
+            keepout = true;
+        }
+        else if( ( symname == "name" || symname == "net_name" )
+            && child->GetNumberOfChildren() > 1 )
+        {
+            SEXPR::SEXPR* val = child->GetChild( 1 );
+            std::string& text = symname == "name" ? name : netname;
+
+            if( val->IsString() )
+                text = val->GetString();
+            else if( val->IsSymbol() )
+                text = val->GetSymbol();
+        }
+        else if( symname == "net" && child->GetNumberOfChildren() > 1
+            && child->GetChild( 1 )->IsInteger() )
+        {
+            net = child->GetChild( 1 )->GetInteger();
+        }
+        else if( symname == "layer" && child->GetNumberOfChildren() > 1 )
+        {
+            layer = getCopperLayer( child->GetChild( 1 ) );
+        }
+        else if( symname == "filled_polygon" && m_zones )
+        {
+            // form: (filled_polygon {(layer L)} (pts (xy x y) ...))
+            KICADZONEFILL fill;
+            fill.m_layer = layer;
+            fill.m_net = net;
+
+            for( size_t j = 1; j < child->GetNumberOfChildren(); ++j )
+            {
+                SEXPR::SEXPR* item = child->GetChild( j );
+
+                if( !item->IsList() || item->GetNumberOfChildren() < 2 )
+                    continue;
+
+                if( item->GetChild( 0 )->GetSymbol() == "layer" )
+                    fill.m_layer = getCopperLayer( item->GetChild( 1 ) );
+                else if( item->GetChild( 0 )->GetSymbol() == "pts" && !fill.ReadPoints( item ) )
+                    return false;
+            }
+
+            if( LAYER_NONE != fill.m_layer && fill.m_points.size() > 2 )
+                m_fills.push_back( std::move( fill ) );
+        }
+        else if( symname == "polygon" )
+        {
+            for( size_t j = 1; j < child->GetNumberOfChildren(); ++j )
+            {
+                SEXPR::SEXPR* pts = child->GetChild( j );
+
+                if( !pts->IsList() || pts->GetChild( 0 )->GetSymbol() != "pts" )
+                    continue;
+
+                for( size_t k = 1; k < pts->GetNumberOfChildren(); ++k )
+                {
+                    DOUBLET pt;
+
+                    if( !Get2DCoordinate( pts->GetChild( k ), pt ) )
+                        return false;
+
+                    bbox.Add( pt.x, pt.y );
+                }
+            }
+        }
+    }
+
+    if( name.empty() )
+        name = netname;
+
+    if( keepout && !name.empty() && !bbox.IsEmpty() )
+        m_keepouts[name].Add( bbox );
+
+    return true;
+}
+
+
+bool KICADPCB::getRegion( BOX2D& aRegion )
+{
+    BOX2D region;
+    std::map< std::string, BOX2D >::const_iterator kp = m_keepouts.find( m_region );
+
+    if( kp != m_keepouts.end() )
+    {
+        region = kp->second;
+    }
+    else
+    {
+        std::string text( m_region );
+        std::replace( text.begin(), text.end(), ',', ' ' );
+        std::istringstream istr( text );
+        double x0, y0, x1, y1;
+        std::string extra;
+
+        if( !( istr >> x0 >> y0 >> x1 >> y1 ) || ( istr >> extra ) )
+        {
+            std::ostringstream ostr;
+            ostr << "** " << __FILE__ << ":" << __FUNCTION__ << ":" << __LINE__ << "\n";
+            ostr << "*  invalid region '" << m_region << "'; expecting x0,y0,x1,y1 ";
+            ostr << "or the name of a keepout zone\n";
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+            return false;
+        }
+
+        region = BOX2D( x0, y0, x1, y1 );
+    }
+
+    // convert to the board model's coordinate system
+    aRegion = BOX2D( region.minx - m_origin.x, m_origin.y - region.miny,
+        region.maxx - m_origin.x, m_origin.y - region.maxy );
+
+    if( aRegion.maxx - aRegion.minx <= 0.0 || aRegion.maxy - aRegion.miny <= 0.0 )
+    {
+        std::ostringstream ostr;
+        ostr << "** " << __FILE__ << ":" << __FUNCTION__ << ":" << __LINE__ << "\n";
+        ostr << "*  region '" << m_region << "' has no area\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+
+bool KICADPCB::getPanel( int& aColumns, int& aRows, DOUBLET& aPitch )
+{
+    if( !m_panel.empty() )
+    {
+        std::string text( m_panel );
+        std::replace( text.begin(), text.end(), 'x', ' ' );
+        std::replace( text.begin(), text.end(), 'X', ' ' );
+        std::istringstream istr( text );
+        std::string extra;
+
+        if( !( istr >> aColumns >> aRows ) || ( istr >> extra ) || aColumns < 1 || aRows < 1 )
+        {
+            std::ostringstream ostr;
+            ostr << "** " << __FILE__ << ":" << __FUNCTION__ << ":" << __LINE__ << "\n";
+            ostr << "*  invalid panel '" << m_panel << "'; expecting NxM (columns x rows)\n";
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+            return false;
+        }
+    }
+
+    if( !m_pitch.empty() )
+    {
+        std::string text( m_pitch );
+        std::replace( text.begin(), text.end(), ',', ' ' );
+        std::istringstream istr( text );
+        std::string extra;
+
+        if( !( istr >> aPitch.x >> aPitch.y ) || ( istr >> extra )
+            || aPitch.x <= 0.0 || aPitch.y <= 0.0 )
+        {
+            std::ostringstream ostr;
+            ostr << "** " << __FILE__ << ":" << __FUNCTION__ << ":" << __LINE__ << "\n";
+            ostr << "*  invalid pitch '" << m_pitch << "'; expecting x,y (mm)\n";
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool KICADPCB::ComposePCB()
+{
+    if( m_pcb )
+        return true;
+
+    if( m_modules.empty() && m_curves.empty() )
+    {
+        std::ostringstream ostr;
+        ostr << "** " << __FILE__ << ":" << __FUNCTION__ << ":" << __LINE__ << "\n";
+        ostr << "*  no PCB data to render\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    BOX2D region;
+
+    if( !m_region.empty() && !getRegion( region ) )
+        return false;
+
+    int columns = 1;
+    int rows = 1;
+    DOUBLET pitch( 0.0, 0.0 );
+
+    if( ( !m_panel.empty() || !m_pitch.empty() ) && !getPanel( columns, rows, pitch ) )
+        return false;
+
+    m_pcb = new PCBMODEL( m_system, m_boardOnly );
+    m_pcb->SetPCBThickness( m_thickness );
+    m_pcb->SetRegion( region );
+    m_pcb->SetBoardCache( m_boardCache );
+    m_pcb->SetModelCache( m_modelCache );
+    m_pcb->SetThreadCount( m_threads );
+    m_pcb->SetTileSize( m_tileSize );
+    m_pcb->SetSimplifyTolerance( m_simplify );
+    m_pcb->SetPanel( columns, rows, pitch, m_rail, m_tab );
+    m_pcb->SetProfiler( m_profiler );
+
+    // board level curves are only translated and mirrored so the
+    // transformation is performed exactly in nanometers
+    NMPOINT origin = ToNM( m_origin );
+
+    for( auto i : m_curves )
+    {
+        if( CURVE_NONE == i->m_form || LAYER_EDGE != i->m_layer )
+            continue;
+
+        // adjust the coordinate system
+        KICADCURVE lcurve = *i;
+        lcurve.m_nmStart.y = -( lcurve.m_nmStart.y - origin.y );
+        lcurve.m_nmEnd.y = -( lcurve.m_nmEnd.y - origin.y );
+        lcurve.m_nmStart.x -= origin.x;
+        lcurve.m_nmEnd.x -= origin.x;
+        lcurve.m_start = ToMM( lcurve.m_nmStart );
+        lcurve.m_end = ToMM( lcurve.m_nmEnd );
+
+        if( CURVE_ARC == lcurve.m_form )
+            lcurve.m_angle = -lcurve.m_angle;
+
+        m_pcb->AddOutlineSegment( &lcurve );
+    }
+
+    // when the export is limited to a region only the components within the
+    // region are added; all modules still contribute outline segments and holes
+    std::vector< char > inside( m_modules.size(), m_region.empty() );
+
+    if( !m_region.empty() )
+    {
+        RTREE< size_t > index;
+        std::vector< size_t > found;
+
+        for( size_t i = 0; i < m_modules.size(); ++i )
+        {
+            BOX2D bbox;
+
+            if( m_modules[i]->GetBoundingBox( m_origin, bbox ) )
+                index.Insert( bbox, i );
+        }
+
+        index.Build();
+        index.Query( region, found );
+
+        for( auto i : found )
+            inside[i] = true;
+    }
+
+    // modules are composed concurrently into separate staging areas which
+    // are then committed in file order so that the output is deterministic
+    std::vector< PCB_STAGE > stages( m_modules.size() );
+
+    {
+        PROFILE_SCOPE timer( m_profiler, "compose modules" );
+
+        ParallelFor( m_modules.size(), m_threads, [&]( size_t aIndex )
+            {
+                // models and pad copper are not part of the bare board
+                m_modules[aIndex]->ComposePCB( m_pcb, &m_resolver, m_origin, &stages[aIndex],
+                    inside[aIndex] && !m_boardOnly, m_pads && inside[aIndex] && !m_boardOnly );
+            } );
+    }
+
+    // messages logged by worker threads are buffered until flushed
+    wxLog::FlushActive();
+
+    {
+        PROFILE_SCOPE timer( m_profiler, "load models" );
+
+        for( auto& i : stages )
+            m_pcb->CommitStage( i );
+    }
+
+    if( m_viaHoles )
+        addViaHoles();
+
+    if( m_tracks && !m_boardOnly )
+        addTracks( region );
+
+    if( m_zones && !m_boardOnly )
+        addZones( region );
 
     if( !m_pcb->CreatePCB() )
     {
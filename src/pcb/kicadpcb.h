@@ -30,10 +30,15 @@
 #define KICADPCB_H
 
 #include <wx/string.h>
+#include <map>
 #include <string>
 #include <vector>
 #include "3d_filename_resolver.h"
 #include "base.h"
+#include "kicadmodule.h"
+#include "kicadtrack.h"
+#include "kicadvia.h"
+#include "kicadzone.h"
 
 #ifdef SUPPORTS_IGES
 #undef SUPPORTS_IGES
@@ -47,6 +52,8 @@ namespace SEXPR
 class KICADMODULE;
 class KICADCURVE;
 class PCBMODEL;
+class MODEL_CACHE;
+class PROFILER;
 
 class KICADPCB
 {
@@ -54,17 +61,87 @@ private:
     S3D_FILENAME_RESOLVER m_resolver;
     std::string m_filename;
     PCBMODEL*   m_pcb;
+    PCBMODEL*   m_system;   // system assembly which receives the board (NULL = none)
+    bool        m_boardOnly;    // set true to export the bare board solid only
+    bool        m_resolverReady;    // set true once the model search paths are set up
     DOUBLET     m_origin;
+    unsigned    m_threads;  // number of worker threads (0 = hardware threads)
+    std::string m_region;   // exported region: "x0,y0,x1,y1" or a keepout name
+    double      m_tileSize; // size of the tiles used to cut the board, mm (0 = no tiles)
+    double      m_simplify; // outline simplification tolerance, mm (0 = none)
+    bool        m_useCache; // set true to use the board data cache
+    std::string m_cacheDir; // cache directory; empty = beside the board file
+    std::string m_boardCache;   // board solid of a previous run; empty = not used
+    MODEL_CACHE* m_modelCache;  // models retained between successive compositions
+    PROFILER*   m_profiler; // optional timing of the export phases
+    bool        m_viaHoles; // set true to drill the through vias
+    bool        m_tracks;   // set true to export the tracks on the outer layers
+    bool        m_zones;    // set true to export the zone fills on the outer layers
+    bool        m_pads;     // set true to export the pad copper on the outer layers
+    std::string m_panel;    // panel layout: "NxM" columns x rows; empty = no panel
+    std::string m_pitch;    // distance between the panel boards: "x,y"; empty = automatic
+    double      m_rail;     // width of the panel rails, mm (0 = none)
+    double      m_tab;      // width of the panel tabs, mm (0 = none)
 
     // PCB parameters/entities
     double                      m_thickness;
     std::vector< KICADMODULE* > m_modules;
+    FOOTPRINT_MAP               m_footprints;   // footprint definitions shared by the modules
     std::vector< KICADCURVE* >  m_curves;
+    std::vector< KICADVIA >     m_vias;         // boards may hold 100k vias so these are stored by value
+    std::vector< KICADTRACK >   m_trackList;    // tracks on the outer layers
+    std::vector< KICADZONEFILL > m_fills;       // zone fills on the outer layers
+    std::map< std::string, BOX2D > m_keepouts;  // extents of named keepout zones
+
+    // via drill defaults; only used while the board file is read
+    double                          m_viaDrill;     // default from the setup section
+    std::map< int, std::string >    m_netNames;     // net numbers to names
+    std::map< std::string, double > m_netViaDrills; // net names to the drill of their net class
 
     bool parsePCB( SEXPR::SEXPR* data );
     bool parseGeneral( SEXPR::SEXPR* data );
+    bool parseSetup( SEXPR::SEXPR* data );
+    bool parseNet( SEXPR::SEXPR* data );
+    bool parseNetClass( SEXPR::SEXPR* data );
     bool parseModule( SEXPR::SEXPR* data );
     bool parseCurve( SEXPR::SEXPR* data, CURVE_TYPE aCurveType );
+    bool parseZone( SEXPR::SEXPR* data );
+    bool parseVia( SEXPR::SEXPR* data );
+    bool parseTrack( SEXPR::SEXPR* data, bool aArc );
+
+    // assign the net class or board default drill to vias without a drill
+    void setViaDrills();
+
+    // add the holes of the through vias to the board model
+    void addViaHoles();
+
+    // merge the tracks of each net and outer layer into copper regions;
+    // only tracks which intersect aRegion are used unless it is empty.
+    // Regions which cross the edge of aRegion are trimmed by the model
+    void addTracks( const BOX2D& aRegion );
+
+    // add the zone fills as copper regions; only fills which
+    // intersect aRegion are used unless it is empty
+    void addZones( const BOX2D& aRegion );
+
+    // convert m_region to a box in the board model's coordinate system
+    bool getRegion( BOX2D& aRegion );
+
+    // read the KiCad configuration and create the list of model search
+    // paths; this is deferred until models are required. The project
+    // directory is set if aProjectDir is not empty. May be invoked
+    // concurrently by the boards of an assembly
+    void initResolver( const wxString& aProjectDir );
+
+    // convert m_panel and m_pitch to the number of boards and their pitch
+    bool getPanel( int& aColumns, int& aRows, DOUBLET& aPitch );
+
+    // board data cache; the cache is only used if it was created
+    // from a board file with the content hash aHash
+    std::string getCacheName() const;
+    bool readCache( const std::string& aCacheName, uint64_t aHash );
+    bool writeCache( const std::string& aCacheName, uint64_t aHash );
+    void clearData();
 
 public:
     KICADPCB();
@@ -76,8 +153,143 @@ public:
         m_origin.y = aYOrigin;
     }
 
+    // set the number of threads used to compose the board (0 = all hardware threads)
+    void SetThreadCount( unsigned aThreads )
+    {
+        m_threads = aThreads;
+    }
+
+    // accumulate the time spent in each phase of the export in aProfiler
+    // (NULL = no timing); the profiler must outlive the object
+    void SetProfiler( PROFILER* aProfiler )
+    {
+        m_profiler = aProfiler;
+    }
+
+    PROFILER* GetProfiler() const
+    {
+        return m_profiler;
+    }
+
+    // cut the holes from square tiles of the board of side aSize (mm)
+    // on separate threads; 0 cuts the whole board at once
+    void SetTileSize( double aSize )
+    {
+        m_tileSize = aSize;
+    }
+
+    // drill the holes of the through vias; blind and micro vias
+    // do not pass through the board and are always ignored
+    void SetViaHoles( bool aViaHoles )
+    {
+        m_viaHoles = aViaHoles;
+    }
+
+    // export the tracks on the outer copper layers as thin solids; the
+    // tracks of each net are merged in 2D before they are extruded. The
+    // tracks are only read from the board file if this is set beforehand
+    void SetTracks( bool aTracks )
+    {
+        m_tracks = aTracks;
+    }
+
+    // export the filled areas of the zones on the outer copper layers; the
+    // fills are only read from the board file if this is set beforehand
+    void SetZones( bool aZones )
+    {
+        m_zones = aZones;
+    }
+
+    // export the copper of the pads on the outer layers; pads of the same
+    // form and size share one shape which is placed once per pad
+    void SetPads( bool aPads )
+    {
+        m_pads = aPads;
+    }
+
+    // merge runs of short outline segments into lines and arcs which
+    // remain within aTolerance (mm) of the original; 0 = no simplification
+    void SetSimplifyTolerance( double aTolerance )
+    {
+        m_simplify = aTolerance;
+    }
+
+    // limit the export to a region given as "x0,y0,x1,y1" (pcbnew
+    // coordinates, mm) or as the name of a keepout zone
+    void SetRegion( const std::string& aRegion )
+    {
+        m_region = aRegion;
+    }
+
+    // export a panel of copies of the board given as "NxM" (columns x rows)
+    // with the boards aPitch ("x,y", mm; empty = automatic) apart; rails of
+    // width aRail and tabs of width aTab frame the boards (0 = none)
+    void SetPanel( const std::string& aPanel, const std::string& aPitch,
+        double aRail, double aTab )
+    {
+        m_panel = aPanel;
+        m_pitch = aPitch;
+        m_rail = aRail;
+        m_tab = aTab;
+    }
+
+    // cache the data extracted from the board file in aCacheDir
+    // (empty = beside the board file) and reuse it while the
+    // content of the board file is unchanged
+    void SetCache( bool aEnable, const std::string& aCacheDir )
+    {
+        m_useCache = aEnable;
+        m_cacheDir = aCacheDir;
+    }
+
+    // reuse the board solid of a previous run stored in aFileName when
+    // the outline and drills are unchanged (empty = always rebuild)
+    void SetBoardCache( const std::string& aFileName )
+    {
+        m_boardCache = aFileName;
+    }
+
+    // retain the models which have been read so that the board may be
+    // composed repeatedly without reading unchanged model files
+    void EnableModelCache();
+
+    // retrieve the names of the board file and all retained model files
+    void GetSourceFiles( std::vector< std::string >& aFileNames ) const;
+
+    // retrieve the resolved names of all model files referenced by the board
+    void GetModelFiles( std::vector< std::string >& aFileNames );
+
+    // notify the object that a model file has changed
+    void ModelChanged( const std::string& aFileName );
+
+    // compose the board in the document of the system assembly aSystem
+    // (NULL = in a document of its own); the system must outlive the board
+    void SetSystem( PCBMODEL* aSystem )
+    {
+        m_system = aSystem;
+    }
+
+    // export the bare board solid with a plain STEP writer; the model
+    // search paths, models, copper, panel and assembly data are skipped
+    void SetBoardOnly( bool aBoardOnly )
+    {
+        m_boardOnly = aBoardOnly;
+    }
+
+    // retrieve the composed model (NULL until ComposePCB() succeeds)
+    PCBMODEL* GetModel() const
+    {
+        return m_pcb;
+    }
+
+    // discard the composed model so that ComposePCB() may be invoked again
+    void ReleaseModel();
+
     bool ReadFile( const wxString& aFileName );
     bool ComposePCB();
+    // validate the board and model solids; returns false if any is invalid
+    bool CheckShapes();
+
     bool WriteSTEP( const wxString& aFileName, bool aOverwrite );
     #ifdef SUPPORTS_IGES
     bool WriteIGES( const wxString& aFileName, bool aOverwrite );
@@ -0,0 +1,150 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+#include <wx/log.h>
+#include <sstream>
+#include "sexpr/sexpr.h"
+#include "kicadtrack.h"
+#include "pcbcache.h"
+
+
+static const char bad_track[] = "* corrupt PCB file; bad track";
+
+
+KICADTRACK::KICADTRACK()
+{
+    m_arc = false;
+    m_layer = LAYER_NONE;
+    m_width = 0.0;
+    m_net = 0;
+    return;
+}
+
+
+KICADTRACK::~KICADTRACK()
+{
+    return;
+}
+
+
+bool KICADTRACK::Read( SEXPR::SEXPR* aEntry, bool aArc )
+{
+    // form: ( segment (start x y) (end x y) (width w) (layer L) (net N) )
+    // or:   ( arc (start x y) (mid x y) (end x y) (width w) (layer L) (net N) )
+    int nchild = aEntry->GetNumberOfChildren();
+    int npoints = 0;
+    m_arc = aArc;
+
+    for( int i = 1; i < nchild; ++i )
+    {
+        SEXPR::SEXPR* child = aEntry->GetChild( i );
+
+        if( !child->IsList() || child->GetNumberOfChildren() < 2 )
+            continue;
+
+        std::string name = child->GetChild( 0 )->GetSymbol();
+        SEXPR::SEXPR* val = child->GetChild( 1 );
+
+        if( name == "start" || name == "mid" || name == "end" )
+        {
+            NMPOINT& pt = name == "start" ? m_start : ( name == "mid" ? m_mid : m_end );
+
+            if( !Get2DCoordinate( child, pt ) )
+                return false;
+
+            ++npoints;
+        }
+        else if( name == "width" )
+        {
+            if( val->IsDouble() )
+                m_width = val->GetDouble();
+            else if( val->IsInteger() )
+                m_width = (double) val->GetInteger();
+        }
+        else if( name == "layer" )
+        {
+            // only the outer copper layers are exported
+            std::string layer;
+
+            if( val->IsSymbol() )
+                layer = val->GetSymbol();
+            else if( val->IsString() )
+                layer = val->GetString();
+
+            if( layer == "F.Cu" )
+                m_layer = LAYER_TOP;
+            else if( layer == "B.Cu" )
+                m_layer = LAYER_BOTTOM;
+        }
+        else if( name == "net" && val->IsInteger() )
+        {
+            m_net = val->GetInteger();
+        }
+    }
+
+    if( npoints < ( aArc ? 3 : 2 ) || m_width <= 0.0 )
+    {
+        std::ostringstream ostr;
+        ostr << bad_track << " (missing points or width)";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+
+void KICADTRACK::WriteCache( CACHE_WRITER& aCache ) const
+{
+    aCache.PutBool( m_arc );
+    aCache.PutInt( m_layer );
+    aCache.PutPoint( m_start );
+    aCache.PutPoint( m_mid );
+    aCache.PutPoint( m_end );
+    aCache.PutDouble( m_width );
+    aCache.PutInt( m_net );
+    return;
+}
+
+
+bool KICADTRACK::ReadCache( CACHE_READER& aCache )
+{
+    m_arc = aCache.GetBool();
+    int64_t layer = aCache.GetInt();
+
+    if( layer < LAYER_NONE || layer > LAYER_EDGE )
+    {
+        aCache.Invalidate();
+        return false;
+    }
+
+    m_layer = (LAYERS) layer;
+    m_start = aCache.GetPoint();
+    m_mid = aCache.GetPoint();
+    m_end = aCache.GetPoint();
+    m_width = aCache.GetDouble();
+    m_net = (int) aCache.GetInt();
+
+    return aCache.IsOK();
+}
@@ -0,0 +1,61 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+/**
+ * @file kicadtrack.h
+ * declares the copper TRACK (segment or arc) description object.
+ */
+
+#ifndef KICADTRACK_H
+#define KICADTRACK_H
+
+#include "base.h"
+
+class CACHE_READER;
+class CACHE_WRITER;
+
+
+class KICADTRACK
+{
+public:
+    KICADTRACK();
+    virtual ~KICADTRACK();
+
+    // read a 'segment' or, if aArc is true, an 'arc' entry
+    bool Read( SEXPR::SEXPR* aEntry, bool aArc );
+
+    // store or restore the parsed data in a board cache
+    void WriteCache( CACHE_WRITER& aCache ) const;
+    bool ReadCache( CACHE_READER& aCache );
+
+    bool        m_arc;      // true if the track is an arc through m_mid
+    LAYERS      m_layer;    // LAYER_TOP or LAYER_BOTTOM; LAYER_NONE for inner layers
+    NMPOINT     m_start;    // end points and arc mid point in exact nanometers
+    NMPOINT     m_mid;
+    NMPOINT     m_end;
+    double      m_width;    // track width, mm
+    int         m_net;      // net number
+};
+
+#endif  // KICADTRACK_H
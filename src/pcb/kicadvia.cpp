@@ -0,0 +1,141 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+#include <wx/log.h>
+#include <sstream>
+#include "sexpr/sexpr.h"
+#include "kicadvia.h"
+#include "pcbcache.h"
+
+
+static const char bad_via[] = "* corrupt PCB file; bad via";
+
+
+KICADVIA::KICADVIA()
+{
+    m_thru = true;
+    m_size = 0.0;
+    m_drill = 0.0;
+    m_net = -1;
+    return;
+}
+
+
+KICADVIA::~KICADVIA()
+{
+    return;
+}
+
+
+bool KICADVIA::Read( SEXPR::SEXPR* aEntry )
+{
+    // form: ( via {blind|micro} (at x y) (size d) (drill d) (layers X X) (net N) );
+    // the drill is omitted if it is the default of the via's net class
+    int nchild = aEntry->GetNumberOfChildren();
+    bool hasPos = false;
+
+    for( int i = 1; i < nchild; ++i )
+    {
+        SEXPR::SEXPR* child = aEntry->GetChild( i );
+
+        if( child->IsSymbol() )
+        {
+            if( child->GetSymbol() == "blind" || child->GetSymbol() == "micro" )
+                m_thru = false;
+
+            continue;
+        }
+
+        if( !child->IsList() || child->GetNumberOfChildren() < 2 )
+            continue;
+
+        std::string name = child->GetChild( 0 )->GetSymbol();
+
+        if( name == "at" )
+        {
+            if( !Get2DCoordinate( child, m_position ) )
+                return false;
+
+            hasPos = true;
+        }
+        else if( name == "net" )
+        {
+            if( child->GetChild( 1 )->IsInteger() )
+                m_net = child->GetChild( 1 )->GetInteger();
+        }
+        else if( name == "size" || name == "drill" )
+        {
+            SEXPR::SEXPR* val = child->GetChild( 1 );
+            double dia;
+
+            if( val->IsDouble() )
+                dia = val->GetDouble();
+            else if( val->IsInteger() )
+                dia = (double) val->GetInteger();
+            else
+            {
+                std::ostringstream ostr;
+                ostr << bad_via << " (invalid " << name << ")";
+                wxLogMessage( "%s\n", ostr.str().c_str() );
+                return false;
+            }
+
+            if( name == "size" )
+                m_size = dia;
+            else
+                m_drill = dia;
+        }
+    }
+
+    if( !hasPos )
+    {
+        std::ostringstream ostr;
+        ostr << bad_via << " (no position)";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+
+void KICADVIA::WriteCache( CACHE_WRITER& aCache ) const
+{
+    aCache.PutBool( m_thru );
+    aCache.PutDoublet( m_position );
+    aCache.PutDouble( m_size );
+    aCache.PutDouble( m_drill );
+    return;
+}
+
+
+bool KICADVIA::ReadCache( CACHE_READER& aCache )
+{
+    m_thru = aCache.GetBool();
+    m_position = aCache.GetDoublet();
+    m_size = aCache.GetDouble();
+    m_drill = aCache.GetDouble();
+
+    return aCache.IsOK();
+}
@@ -0,0 +1,66 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+/**
+ * @file kicadvia.h
+ * declares the VIA description object.
+ */
+
+#ifndef KICADVIA_H
+#define KICADVIA_H
+
+#include "base.h"
+
+class CACHE_READER;
+class CACHE_WRITER;
+
+
+class KICADVIA
+{
+private:
+    bool        m_thru;     // false for blind and micro vias
+
+public:
+    KICADVIA();
+    virtual ~KICADVIA();
+
+    bool Read( SEXPR::SEXPR* aEntry );
+
+    // store or restore the parsed data in a board cache
+    void WriteCache( CACHE_WRITER& aCache ) const;
+    bool ReadCache( CACHE_READER& aCache );
+
+    // true if the via passes through all layers of the board
+    bool IsThruHole()
+    {
+        return m_thru;
+    }
+
+    DOUBLET     m_position;
+    double      m_size;     // diameter of the copper annulus
+    double      m_drill;    // diameter of the drill; 0 until the net class default is applied
+    int         m_net;      // net number; only used while the board file is read
+};
+
+#endif  // KICADVIA_H
@@ -0,0 +1,126 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+#include <wx/log.h>
+#include <cmath>
+#include <sstream>
+#include "sexpr/sexpr.h"
+#include "kicadzone.h"
+#include "pcbcache.h"
+
+// maximum distance (nm) of a point from the line through its neighbours
+// for the point to be removed
+#define COLLINEAR_DIST ( 1.0 )
+
+
+KICADZONEFILL::KICADZONEFILL()
+{
+    m_layer = LAYER_NONE;
+    m_net = 0;
+    return;
+}
+
+
+KICADZONEFILL::~KICADZONEFILL()
+{
+    return;
+}
+
+
+bool KICADZONEFILL::ReadPoints( SEXPR::SEXPR* aPoints )
+{
+    // form: (pts (xy x y) (xy x y) ... )
+    size_t nc = aPoints->GetNumberOfChildren();
+    m_points.reserve( m_points.size() + nc - 1 );
+
+    for( size_t i = 1; i < nc; ++i )
+    {
+        NMPOINT pt;
+
+        if( !Get2DCoordinate( aPoints->GetChild( i ), pt ) )
+            return false;
+
+        size_t np = m_points.size();
+
+        if( np > 0 && m_points[np - 1] == pt )
+            continue;
+
+        // replace the last point if it lies on the line to the new point
+        if( np > 1 )
+        {
+            const NMPOINT& p0 = m_points[np - 2];
+            const NMPOINT& p1 = m_points[np - 1];
+            double ax = (double) ( p1.x - p0.x );
+            double ay = (double) ( p1.y - p0.y );
+            double bx = (double) ( pt.x - p1.x );
+            double by = (double) ( pt.y - p1.y );
+            double len = std::hypot( ax + bx, ay + by );
+
+            if( ax * bx + ay * by > 0.0
+                && std::fabs( ax * by - ay * bx ) <= COLLINEAR_DIST * len )
+            {
+                m_points[np - 1] = pt;
+                continue;
+            }
+        }
+
+        m_points.push_back( pt );
+    }
+
+    return true;
+}
+
+
+void KICADZONEFILL::WriteCache( CACHE_WRITER& aCache ) const
+{
+    aCache.PutInt( m_layer );
+    aCache.PutInt( m_net );
+    aCache.PutInt( (int64_t) m_points.size() );
+
+    for( const auto& i : m_points )
+        aCache.PutPoint( i );
+
+    return;
+}
+
+
+bool KICADZONEFILL::ReadCache( CACHE_READER& aCache )
+{
+    int64_t layer = aCache.GetInt();
+
+    if( layer < LAYER_NONE || layer > LAYER_EDGE )
+    {
+        aCache.Invalidate();
+        return false;
+    }
+
+    m_layer = (LAYERS) layer;
+    m_net = (int) aCache.GetInt();
+    int64_t n = aCache.GetInt();
+
+    for( int64_t i = 0; i < n && aCache.IsOK(); ++i )
+        m_points.push_back( aCache.GetPoint() );
+
+    return aCache.IsOK();
+}
@@ -0,0 +1,59 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+/**
+ * @file kicadzone.h
+ * declares the object which holds one filled area of a copper zone.
+ */
+
+#ifndef KICADZONE_H
+#define KICADZONE_H
+
+#include <vector>
+#include "base.h"
+
+class CACHE_READER;
+class CACHE_WRITER;
+
+
+class KICADZONEFILL
+{
+public:
+    KICADZONEFILL();
+    virtual ~KICADZONEFILL();
+
+    // read the points of a 'pts' list; runs of collinear points are
+    // merged as they are read so that only the corners are retained
+    bool ReadPoints( SEXPR::SEXPR* aPoints );
+
+    // store or restore the parsed data in a board cache
+    void WriteCache( CACHE_WRITER& aCache ) const;
+    bool ReadCache( CACHE_READER& aCache );
+
+    LAYERS                  m_layer;    // LAYER_TOP or LAYER_BOTTOM
+    int                     m_net;      // net number
+    std::vector< NMPOINT >  m_points;   // fractured outline as written by KiCad
+};
+
+#endif  // KICADZONE_H
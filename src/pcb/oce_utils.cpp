@@ -22,25 +22,34 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <sstream>
 #include <string>
 #include <utility>
+#include <wx/filefn.h>
 #include <wx/filename.h>
 #include <wx/log.h>
 
 #include "oce_utils.h"
+#include "geom2d.h"
 #include "kicadpad.h"
+#include "parallel.h"
+#include "profiler.h"
+#include "rtree.h"
 
 #include <IGESCAFControl_Reader.hxx>
 #include <IGESCAFControl_Writer.hxx>
 #include <IGESControl_Controller.hxx>
+#include <IGESControl_Writer.hxx>
 #include <IGESData_GlobalSection.hxx>
 #include <IGESData_IGESModel.hxx>
 #include <Interface_Static.hxx>
 #include <Quantity_Color.hxx>
 #include <STEPCAFControl_Reader.hxx>
 #include <STEPCAFControl_Writer.hxx>
+#include <STEPControl_Writer.hxx>
+#include <Standard_Version.hxx>
 #include <APIHeaderSection_MakeHeader.hxx>
 #include <TCollection_ExtendedString.hxx>
 #include <TDataStd_Name.hxx>
@@ -50,14 +59,32 @@
 #include <XCAFDoc_DocumentTool.hxx>
 #include <XCAFDoc_ColorTool.hxx>
 
+#include <BRep_Builder.hxx>
 #include <BRep_Tool.hxx>
+#include <BRepTools.hxx>
 #include <BRepMesh_IncrementalMesh.hxx>
 #include <BRepBuilderAPI_MakeEdge.hxx>
 #include <BRepBuilderAPI_Transform.hxx>
 #include <BRepBuilderAPI_MakeFace.hxx>
+#include <BRepBuilderAPI_MakePolygon.hxx>
 #include <BRepPrimAPI_MakePrism.hxx>
+#include <BRepPrimAPI_MakeBox.hxx>
 #include <BRepPrimAPI_MakeCylinder.hxx>
+#include <BRepAlgoAPI_Common.hxx>
 #include <BRepAlgoAPI_Cut.hxx>
+#include <BRepCheck_Analyzer.hxx>
+#include <TopTools_ListOfShape.hxx>
+
+#if OCC_VERSION_HEX >= 0x070400
+#include <OSD_ThreadPool.hxx>
+#endif
+
+#if OCC_VERSION_HEX >= 0x070100
+#include <Bnd_Box.hxx>
+#include <BRepAlgoAPI_Fuse.hxx>
+#include <BRepBndLib.hxx>
+#include <ShapeUpgrade_UnifySameDomain.hxx>
+#endif
 
 #include <TopoDS.hxx>
 #include <TopoDS_Wire.hxx>
@@ -68,6 +95,7 @@
 #include <gp_Ax2.hxx>
 #include <gp_Circ.hxx>
 #include <gp_Dir.hxx>
+#include <gp_Pln.hxx>
 #include <gp_Pnt.hxx>
 
 #define USER_PREC (1e-4)
@@ -80,6 +108,23 @@
 #define BOARD_OFFSET (0.05 )
 // min. length**2 below which 2 points are considered coincident
 #define MIN_LENGTH2 (0.0001)
+// header of the board solid cache; the version must be incremented
+// whenever the construction of the board changes
+#define BOARD_CACHE_MAGIC "K2MC-BOARD"
+#define BOARD_CACHE_VERSION (3)
+// maximum deviation (mm) from the true profiles of the polygons used for 2D checks
+#define ARC_DEVIATION (0.005)
+// maximum deviation (mm) from the arcs of the polygons used to check the outlines
+#define CHECK_DEVIATION (0.001)
+// minimum number of line segments which may be replaced by an arc
+#define MIN_ARC_SEGMENTS (4)
+// maximum number of line segments merged into a single line or arc; every
+// extension of a run rechecks the whole run so the cost grows with its square
+#define MAX_SIMPLIFY_RUN (64)
+// thickness (mm) of the exported copper (1 oz)
+#define COPPER_THICKNESS (0.035)
+// default space between the boards of a panel and between the boards and the rails
+#define PANEL_GAP (2.0)
 
 static void getEndPoints( const KICADCURVE& aCurve, double& spx0, double& spy0,
     double& epx0, double& epy0 )
@@ -139,6 +184,71 @@ static void reverseCurve( KICADCURVE& aCurve )
 }
 
 
+static CURVE_KEY getCurveKey( const KICADCURVE& aCurve )
+{
+    CURVE_KEY key;
+    key.fill( 0 );
+    key[0] = aCurve.m_form;
+
+    switch( aCurve.m_form )
+    {
+        case CURVE_LINE:
+            do
+            {
+                NMPOINT p0 = aCurve.m_nmStart;
+                NMPOINT p1 = aCurve.m_nmEnd;
+
+                if( p1 < p0 )
+                    std::swap( p0, p1 );
+
+                key[1] = p0.x;
+                key[2] = p0.y;
+                key[3] = p1.x;
+                key[4] = p1.y;
+            } while( 0 );
+
+            break;
+
+        case CURVE_ARC:
+            do
+            {
+                // the arc is keyed by its center, end points and the angle
+                // subtended when traversing from the lesser end point
+                NMPOINT p0 = aCurve.m_nmEnd;
+                NMPOINT p1 = ToNM( aCurve.m_ep );
+                int64_t angle = (int64_t) std::llround( aCurve.m_angle * 1.0e9 );
+
+                if( p1 < p0 )
+                {
+                    std::swap( p0, p1 );
+                    angle = -angle;
+                }
+
+                key[1] = aCurve.m_nmStart.x;
+                key[2] = aCurve.m_nmStart.y;
+                key[3] = p0.x;
+                key[4] = p0.y;
+                key[5] = p1.x;
+                key[6] = p1.y;
+                key[7] = angle;
+            } while( 0 );
+
+            break;
+
+        case CURVE_CIRCLE:
+            key[1] = aCurve.m_nmStart.x;
+            key[2] = aCurve.m_nmStart.y;
+            key[3] = MMToNM( aCurve.m_radius );
+            break;
+
+        default:
+            break;
+    }
+
+    return key;
+}
+
+
 // supported file types
 enum FormatType
 {
@@ -205,31 +315,123 @@ FormatType fileType( const char* aFileName )
 }
 
 
-PCBMODEL::PCBMODEL()
+PCBMODEL::PCBMODEL( PCBMODEL* aSystem, bool aBoardOnly )
 {
-    m_app = XCAFApp_Application::GetApplication();
-    m_app->NewDocument( "MDTV-XCAF", m_doc );
-    m_assy = XCAFDoc_DocumentTool::ShapeTool ( m_doc->Main() );
-    m_assy_label = m_assy->NewShape();
+    m_system = aBoardOnly ? NULL : aSystem;
+    m_boardOnly = aBoardOnly;
+    m_modelMap = &m_models;
+
+    if( !aBoardOnly )
+        m_app = XCAFApp_Application::GetApplication();
+
+    if( aBoardOnly )
+    {
+        // no document is required for the bare board solid
+    }
+    else if( m_system )
+    {
+        m_doc = aSystem->m_doc;
+        m_assy = aSystem->m_assy;
+        m_modelMap = &aSystem->m_models;
+    }
+    else
+    {
+        m_app->NewDocument( "MDTV-XCAF", m_doc );
+        m_assy = XCAFDoc_DocumentTool::ShapeTool ( m_doc->Main() );
+    }
+
+    if( !aBoardOnly )
+    {
+        std::unique_lock< std::mutex > lock = lockDocument();
+        m_assy_label = m_assy->NewShape();
+    }
+
     m_hasPCB = false;
+    m_copperFailed[0] = 0;
+    m_copperFailed[1] = 0;
     m_components = 0;
     m_precision = USER_PREC;
     m_angleprec = USER_ANGLE_PREC;
     m_thickness = THICKNESS_DEFAULT;
     m_minx = 1.0e10;    // absurdly large number; any valid PCB X value will be smaller
     m_mincurve = m_curves.end();
+    m_hasRegion = false;
+    m_modelCache = NULL;
+    m_threads = 0;
+    m_profiler = NULL;
+    m_tileSize = 0.0;
+    m_simplify = 0.0;
+    m_panelColumns = 1;
+    m_panelRows = 1;
+    m_panelRail = 0.0;
+    m_panelTab = 0.0;
     return;
 }
 
 
 PCBMODEL::~PCBMODEL()
 {
-    m_doc->Close();
+    // a shared document is closed by the system assembly
+    if( NULL == m_system && !m_doc.IsNull() )
+        m_doc->Close();
+
     return;
 }
 
+
+std::unique_lock< std::mutex > PCBMODEL::lockDocument()
+{
+    if( NULL == m_system )
+        return std::unique_lock< std::mutex >();
+
+    return std::unique_lock< std::mutex >( m_system->m_docLock );
+}
+
+
+bool PCBMODEL::AddBoard( PCBMODEL* aBoard, const std::string& aName,
+    const TRIPLET& aPosition, const TRIPLET& aRotation )
+{
+    if( NULL == aBoard || aBoard->m_system != this || aBoard->m_pcb_label.IsNull() )
+        return false;
+
+    gp_Trsf lPos;
+    lPos.SetTranslation( gp_Vec( aPosition.x, aPosition.y, aPosition.z ) );
+
+    // the rotations are applied in the order X, Y, Z
+    const double angles[3] = { aRotation.z, aRotation.y, aRotation.x };
+    const gp_Dir axes[3] = { gp_Dir( 0.0, 0.0, 1.0 ), gp_Dir( 0.0, 1.0, 0.0 ),
+        gp_Dir( 1.0, 0.0, 0.0 ) };
+
+    for( int i = 0; i < 3; ++i )
+    {
+        if( angles[i] < -m_angleprec || angles[i] > m_angleprec )
+        {
+            gp_Trsf lRot;
+            lRot.SetRotation( gp_Ax1( gp_Pnt( 0.0, 0.0, 0.0 ), axes[i] ), angles[i] * M_PI / 180.0 );
+            lPos.Multiply( lRot );
+        }
+    }
+
+    TDF_Label board = aBoard->m_panel_label.IsNull() ? aBoard->m_assy_label : aBoard->m_panel_label;
+    TDataStd_Name::Set( board, TCollection_ExtendedString( aName.c_str() ) );
+    TDF_Label label = m_assy->AddComponent( m_assy_label, board, TopLoc_Location( lPos ) );
+
+    if( label.IsNull() )
+    {
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+        ostr << "  * could not place the board '" << aName << "' in the assembly\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    TDataStd_Name::Set( label, TCollection_ExtendedString( aName.c_str() ) );
+    m_boardLabels.push_back( std::make_pair( aName, aBoard->m_pcb_label ) );
+    return true;
+}
+
 // add an outline segment
-bool PCBMODEL::AddOutlineSegment( KICADCURVE* aCurve )
+bool PCBMODEL::AddOutlineSegment( KICADCURVE* aCurve, PCB_STAGE* aStage )
 {
     if( NULL == aCurve || LAYER_EDGE != aCurve->m_layer || CURVE_NONE == aCurve->m_form )
         return false;
@@ -307,21 +509,45 @@ bool PCBMODEL::AddOutlineSegment( KICADCURVE* aCurve )
         }
     }
 
-    m_curves.push_back( *aCurve );
+    if( aStage )
+    {
+        aStage->m_curves.push_back( *aCurve );
+        return true;
+    }
+
+    return addCurve( *aCurve );
+}
+
+
+bool PCBMODEL::addCurve( const KICADCURVE& aCurve )
+{
+    // reject exact duplicates; an overlapping copy of a segment
+    // would otherwise prevent the outline from being closed
+    if( !m_curveKeys.insert( getCurveKey( aCurve ) ).second )
+    {
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+        ostr << "  * rejected a duplicate outline segment at (";
+        ostr << aCurve.m_start.x << ", " << aCurve.m_start.y << ")\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    m_curves.push_back( aCurve );
 
     // check if this curve has the current leftmost feature
-    switch( aCurve->m_form )
+    switch( aCurve.m_form )
     {
         case CURVE_LINE:
-            if( aCurve->m_start.x < m_minx )
+            if( aCurve.m_start.x < m_minx )
             {
-                m_minx = aCurve->m_start.x;
+                m_minx = aCurve.m_start.x;
                 m_mincurve = --(m_curves.end());
             }
 
-            if( aCurve->m_end.x < m_minx )
+            if( aCurve.m_end.x < m_minx )
             {
-                m_minx = aCurve->m_end.x;
+                m_minx = aCurve.m_end.x;
                 m_mincurve = --(m_curves.end());
             }
 
@@ -330,7 +556,7 @@ bool PCBMODEL::AddOutlineSegment( KICADCURVE* aCurve )
         case CURVE_CIRCLE:
             do
             {
-                double dx = aCurve->m_start.x - aCurve->m_radius;
+                double dx = aCurve.m_start.x - aCurve.m_radius;
 
                 if( dx < m_minx )
                 {
@@ -344,8 +570,8 @@ bool PCBMODEL::AddOutlineSegment( KICADCURVE* aCurve )
         case CURVE_ARC:
             do
             {
-                double dx0 = aCurve->m_end.x - aCurve->m_start.x;
-                double dy0 = aCurve->m_end.y - aCurve->m_start.y;
+                double dx0 = aCurve.m_end.x - aCurve.m_start.x;
+                double dy0 = aCurve.m_end.y - aCurve.m_start.y;
                 int q0;  // quadrant of start point
 
                 if( dx0 > 0.0 && dy0 >= 0.0 )
@@ -357,8 +583,8 @@ bool PCBMODEL::AddOutlineSegment( KICADCURVE* aCurve )
                 else
                     q0 = 4;
 
-                double dx1 = aCurve->m_ep.x - aCurve->m_start.x;
-                double dy1 = aCurve->m_ep.y - aCurve->m_start.y;
+                double dx1 = aCurve.m_ep.x - aCurve.m_start.x;
+                double dy1 = aCurve.m_ep.y - aCurve.m_start.y;
                 int q1;  // quadrant of end point
 
                 if( dx1 > 0.0 && dy1 >= 0.0 )
@@ -371,10 +597,10 @@ bool PCBMODEL::AddOutlineSegment( KICADCURVE* aCurve )
                     q1 = 4;
 
                 // calculate x0, y0 for the start point on a CCW arc
-                double x0 = aCurve->m_end.x;
-                double x1 = aCurve->m_ep.x;
+                double x0 = aCurve.m_end.x;
+                double x1 = aCurve.m_ep.x;
 
-                if( aCurve->m_angle < 0.0 )
+                if( aCurve.m_angle < 0.0 )
                 {
                     std::swap( q0, q1 );
                     std::swap( x0, x1 );
@@ -383,7 +609,7 @@ bool PCBMODEL::AddOutlineSegment( KICADCURVE* aCurve )
                 double minx;
 
                 if( ( q0 <= 2 && q1 >= 3 ) || ( q0 >= 3 && x0 > x1 ) )
-                    minx = aCurve->m_start.x - aCurve->m_radius;
+                    minx = aCurve.m_start.x - aCurve.m_radius;
                 else
                     minx = std::min( x0, x1 );
 
@@ -403,7 +629,7 @@ bool PCBMODEL::AddOutlineSegment( KICADCURVE* aCurve )
             {
                 std::ostringstream ostr;
                 ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
-                ostr << "  * unsupported curve type: '" << aCurve->m_form << "'\n";
+                ostr << "  * unsupported curve type: '" << aCurve.m_form << "'\n";
                 wxLogMessage( "%s\n", ostr.str().c_str() );
             } while( 0 );
 
@@ -415,176 +641,345 @@ bool PCBMODEL::AddOutlineSegment( KICADCURVE* aCurve )
 
 
 // add a pad hole or slot
-bool PCBMODEL::AddPadHole( KICADPAD* aPad )
+bool PCBMODEL::AddPadHole( KICADPAD* aPad, PCB_STAGE* aStage )
 {
+    std::vector< CUTOUT >& cutouts = aStage ? aStage->m_cutouts : m_cutouts;
+
     if( NULL == aPad || !aPad->IsThruHole() )
         return false;
 
-    if( !aPad->m_drill.oval )
+    CUTOUT cutout;
+    double hsize = 0.5 * std::max( aPad->m_drill.size.x, aPad->m_drill.size.y );
+
+    do
     {
-        TopoDS_Shape s = BRepPrimAPI_MakeCylinder( aPad->m_drill.size.x * 0.5,
-            m_thickness * 2.0 ).Shape();
-        gp_Trsf shift;
-        shift.SetTranslation( gp_Vec( aPad->m_position.x, aPad->m_position.y, -m_thickness * 0.5 ) );
-        BRepBuilderAPI_Transform hole( s, shift );
-        m_cutouts.push_back( hole.Shape() );
-        return true;
+        int64_t key[6];
+        key[0] = MMToNM( aPad->m_position.x );
+        key[1] = MMToNM( aPad->m_position.y );
+        key[2] = MMToNM( aPad->m_drill.size.x );
+        key[3] = MMToNM( aPad->m_drill.size.y );
+        key[4] = aPad->m_drill.oval ? 1 : 0;
+        key[5] = aPad->m_drill.oval ? (int64_t) std::llround( aPad->m_rotation * 1.0e9 ) : 0;
+        cutout.m_key = HashBytes( key, sizeof( key ) );
+    } while( 0 );
+
+    cutout.m_bbox = BOX2D( aPad->m_position.x - hsize, aPad->m_position.y - hsize,
+        aPad->m_position.x + hsize, aPad->m_position.y + hsize );
+
+    // the primitive of a slot lies along the X axis
+    double angle = 0.0;
+    double length = aPad->m_drill.size.x;
+    double width = aPad->m_drill.size.x;
+
+    if( aPad->m_drill.oval )
+    {
+        if( aPad->m_drill.size.x < aPad->m_drill.size.y )
+        {
+            angle = M_PI_2;
+            length = aPad->m_drill.size.y;
+        }
+        else
+        {
+            width = aPad->m_drill.size.y;
+        }
+
+        angle += aPad->m_rotation;
+    }
+
+    if( !placeHole( aPad->m_position, length, width, angle, cutout ) )
+        return false;
+
+    cutouts.push_back( cutout );
+    return true;
+}
+
+
+bool PCBMODEL::AddViaHole( const DOUBLET& aPosition, double aDrill, PCB_STAGE* aStage )
+{
+    std::vector< CUTOUT >& cutouts = aStage ? aStage->m_cutouts : m_cutouts;
+
+    if( aDrill <= 0.0 )
+        return false;
+
+    CUTOUT cutout;
+    double hsize = 0.5 * aDrill;
+
+    do
+    {
+        // same layout as the key of a round pad hole
+        int64_t key[6];
+        key[0] = MMToNM( aPosition.x );
+        key[1] = MMToNM( aPosition.y );
+        key[2] = MMToNM( aDrill );
+        key[3] = key[2];
+        key[4] = 0;
+        key[5] = 0;
+        cutout.m_key = HashBytes( key, sizeof( key ) );
+    } while( 0 );
+
+    cutout.m_bbox = BOX2D( aPosition.x - hsize, aPosition.y - hsize,
+        aPosition.x + hsize, aPosition.y + hsize );
+
+    if( !placeHole( aPosition, aDrill, aDrill, 0.0, cutout ) )
+        return false;
+
+    cutouts.push_back( cutout );
+    return true;
+}
+
+
+bool PCBMODEL::AddPadCopper( KICADPAD* aPad, PCB_STAGE* aStage )
+{
+    std::vector< PAD_COPPER >& pads = aStage ? aStage->m_pads : m_pads;
+
+    if( NULL == aPad || PAD_OTHER == aPad->m_shape
+        || ( !aPad->m_topCopper && !aPad->m_bottomCopper ) )
+        return false;
+
+    PAD_COPPER pad;
+    int64_t sx = MMToNM( aPad->m_size.x );
+    int64_t sy = MMToNM( aPad->m_size.y );
+    int64_t smin = std::min( sx, sy );
+    int64_t rad = 0;
+    PAD_SHAPE shape = aPad->m_shape;
+
+    if( smin <= 0 )
+        return false;
+
+    // reduce each pad to the simplest form so that equivalent pads share a shape
+    if( PAD_CIRCLE == shape || ( PAD_OVAL == shape && sx == sy ) )
+    {
+        shape = PAD_CIRCLE;
+        sy = sx;
+    }
+    else if( PAD_OVAL == shape )
+    {
+        rad = smin / 2;
     }
+    else if( PAD_ROUNDRECT == shape )
+    {
+        rad = std::min( (int64_t) std::llround( smin * aPad->m_rratio ), smin / 2 );
 
-    // slotted hole
-    double angle_offset = 0.0;
-    double rad;     // radius of the slot
-    double hlen;    // half length of the slot
+        if( rad <= 0 )
+            shape = PAD_RECT;
+    }
 
-    if( aPad->m_drill.size.x < aPad->m_drill.size.y )
+    pad.m_key[0] = shape;
+    pad.m_key[1] = sx;
+    pad.m_key[2] = sy;
+    pad.m_key[3] = rad;
+    pad.m_key[4] = 0;
+    pad.m_key[5] = 0;
+    pad.m_key[6] = 0;
+
+    // the hole of a plated pad is left open; as in AddPadHole() a slot lies
+    // along the longer side and the offset of the copper is ignored
+    if( aPad->IsThruHole() )
     {
-        angle_offset = M_PI_2;
-        rad = aPad->m_drill.size.x * 0.5;
-        hlen = aPad->m_drill.size.y * 0.5 - rad;
+        int64_t dx = MMToNM( aPad->m_drill.size.x );
+        int64_t dy = aPad->m_drill.oval ? MMToNM( aPad->m_drill.size.y ) : dx;
+
+        if( dx > 0 && dy > 0 && dx < sx && dy < sy )
+        {
+            pad.m_key[4] = std::max( dx, dy );
+            pad.m_key[5] = std::min( dx, dy );
+            pad.m_key[6] = dx < dy ? 1 : 0;
+        }
     }
-    else
+
+    pad.m_position = aPad->m_position;
+    pad.m_angle = aPad->m_rotation;
+
+    if( aPad->m_topCopper )
+    {
+        pad.m_bottom = false;
+        pads.push_back( pad );
+    }
+
+    if( aPad->m_bottomCopper )
     {
-        rad = aPad->m_drill.size.y * 0.5;
-        hlen = aPad->m_drill.size.x * 0.5 - rad;
+        pad.m_bottom = true;
+        pads.push_back( pad );
     }
 
-    DOUBLET c0( -hlen, 0.0 );
-    DOUBLET c1( hlen, 0.0 );
-    DOUBLET p0( -hlen, rad );
-    DOUBLET p1( -hlen, -rad );
-    DOUBLET p2(  hlen, -rad );
-    DOUBLET p3( hlen, rad );
+    return true;
+}
+
+
+bool PCBMODEL::placeHole( const DOUBLET& aPosition, double aLength, double aWidth,
+    double aAngle, CUTOUT& aCutout )
+{
+    aCutout.m_primitive = getHolePrimitive( aLength, aWidth );
+
+    if( !aCutout.m_primitive )
+        return false;
 
-    angle_offset += aPad->m_rotation;
+    double angle = aAngle;
+    gp_Trsf lPos;
+    lPos.SetTranslation( gp_Vec( aPosition.x, aPosition.y, 0.0 ) );
     double dlim = (double)std::numeric_limits< float >::epsilon();
 
-    if( angle_offset < -dlim || angle_offset > dlim )
-    {
-        double vsin = sin( angle_offset );
-        double vcos = cos( angle_offset );
-
-        double x = c0.x * vcos - c0.y * vsin;
-        double y = c0.x * vsin + c0.y * vcos;
-        c0.x = x;
-        c0.y = y;
-
-        x = c1.x * vcos - c1.y * vsin;
-        y = c1.x * vsin + c1.y * vcos;
-        c1.x = x;
-        c1.y = y;
-
-        x = p0.x * vcos - p0.y * vsin;
-        y = p0.x * vsin + p0.y * vcos;
-        p0.x = x;
-        p0.y = y;
-
-        x = p1.x * vcos - p1.y * vsin;
-        y = p1.x * vsin + p1.y * vcos;
-        p1.x = x;
-        p1.y = y;
-
-        x = p2.x * vcos - p2.y * vsin;
-        y = p2.x * vsin + p2.y * vcos;
-        p2.x = x;
-        p2.y = y;
-
-        x = p3.x * vcos - p3.y * vsin;
-        y = p3.x * vsin + p3.y * vcos;
-        p3.x = x;
-        p3.y = y;
-    }
-
-    c0.x += aPad->m_position.x;
-    c0.y += aPad->m_position.y;
-    c1.x += aPad->m_position.x;
-    c1.y += aPad->m_position.y;
-    p0.x += aPad->m_position.x;
-    p0.y += aPad->m_position.y;
-    p1.x += aPad->m_position.x;
-    p1.y += aPad->m_position.y;
-    p2.x += aPad->m_position.x;
-    p2.y += aPad->m_position.y;
-    p3.x += aPad->m_position.x;
-    p3.y += aPad->m_position.y;
+    if( angle < -dlim || angle > dlim )
+    {
+        gp_Trsf lRot;
+        lRot.SetRotation( gp_Ax1( gp_Pnt( 0.0, 0.0, 0.0 ), gp_Dir( 0.0, 0.0, 1.0 ) ), angle );
+        lPos.Multiply( lRot );
+    }
+    else
+    {
+        angle = 0.0;
+    }
+
+    aCutout.m_location = TopLoc_Location( lPos );
+    aCutout.m_wire = TopoDS::Wire( aCutout.m_primitive->m_wire.Moved( aCutout.m_location ) );
+
+    double vsin = sin( angle );
+    double vcos = cos( angle );
+    aCutout.m_polygon.reserve( aCutout.m_primitive->m_polygon.size() );
+
+    for( const auto& i : aCutout.m_primitive->m_polygon )
+    {
+        aCutout.m_polygon.push_back( DOUBLET( i.x * vcos - i.y * vsin + aPosition.x,
+            i.x * vsin + i.y * vcos + aPosition.y ) );
+    }
+
+    return true;
+}
+
+
+std::shared_ptr< CUTOUT_PRIMITIVE > PCBMODEL::getHolePrimitive( double aLength, double aWidth )
+{
+    CUTOUT_PRIMITIVE_KEY key;
+    key[0] = MMToNM( aLength );
+    key[1] = MMToNM( aWidth );
+
+    std::lock_guard< std::mutex > lock( m_primitiveLock );
+    auto prim = m_primitives.find( key );
 
+    if( prim != m_primitives.end() )
+        return prim->second;
+
+    double rad = aWidth * 0.5;      // radius of the hole or slot ends
+    double hlen = aLength * 0.5 - rad;  // half length of the slot
     OUTLINE oln;
-    KICADCURVE crv0, crv1, crv2, crv3;
-
-    // crv0 = arc
-    crv0.m_start = c0;
-    crv0.m_end = p0;
-    crv0.m_ep = p1;
-    crv0.m_angle = M_PI;
-    crv0.m_radius = rad;
-    crv0.m_form = CURVE_ARC;
-
-    // crv1 = line
-    crv1.m_start = p1;
-    crv1.m_end = p2;
-    crv1.m_form = CURVE_LINE;
-
-    // crv2 = arc
-    crv2.m_start = c1;
-    crv2.m_end = p2;
-    crv2.m_ep = p3;
-    crv2.m_angle = M_PI;
-    crv2.m_radius = rad;
-    crv2.m_form = CURVE_ARC;
-
-    // crv3 = line
-    crv3.m_start = p3;
-    crv3.m_end = p0;
-    crv3.m_form = CURVE_LINE;
-
-    oln.AddSegment( crv0 );
-    oln.AddSegment( crv1 );
-    oln.AddSegment( crv2 );
-    oln.AddSegment( crv3 );
-    TopoDS_Shape slot;
-
-    if( oln.MakeShape( slot, m_thickness ) )
-    {
-        if( !slot.IsNull() )
-            m_cutouts.push_back( slot );
 
-        return true;
+    if( key[0] <= key[1] )
+    {
+        KICADCURVE crv;
+        crv.m_form = CURVE_CIRCLE;
+        crv.m_end = DOUBLET( rad, 0.0 );
+        crv.m_radius = rad;
+        oln.AddSegment( crv );
+    }
+    else
+    {
+        DOUBLET c0( -hlen, 0.0 );
+        DOUBLET c1( hlen, 0.0 );
+        DOUBLET p0( -hlen, rad );
+        DOUBLET p1( -hlen, -rad );
+        DOUBLET p2(  hlen, -rad );
+        DOUBLET p3( hlen, rad );
+        KICADCURVE crv0, crv1, crv2, crv3;
+
+        // crv0 = arc
+        crv0.m_start = c0;
+        crv0.m_end = p0;
+        crv0.m_ep = p1;
+        crv0.m_angle = M_PI;
+        crv0.m_radius = rad;
+        crv0.m_form = CURVE_ARC;
+
+        // crv1 = line
+        crv1.m_start = p1;
+        crv1.m_end = p2;
+        crv1.m_form = CURVE_LINE;
+
+        // crv2 = arc
+        crv2.m_start = c1;
+        crv2.m_end = p2;
+        crv2.m_ep = p3;
+        crv2.m_angle = M_PI;
+        crv2.m_radius = rad;
+        crv2.m_form = CURVE_ARC;
+
+        // crv3 = line
+        crv3.m_start = p3;
+        crv3.m_end = p0;
+        crv3.m_form = CURVE_LINE;
+
+        oln.AddSegment( crv0 );
+        oln.AddSegment( crv1 );
+        oln.AddSegment( crv2 );
+        oln.AddSegment( crv3 );
     }
 
-    return false;
+    std::shared_ptr< CUTOUT_PRIMITIVE > hole = std::make_shared< CUTOUT_PRIMITIVE >();
+
+    if( !oln.MakeWire( hole->m_wire ) )
+        return std::shared_ptr< CUTOUT_PRIMITIVE >();
+
+    oln.GetPolygon( hole->m_polygon, ARC_DEVIATION );
+    m_primitives[key] = hole;
+
+    return hole;
 }
 
 
 // add a component at the given position and orientation
 bool PCBMODEL::AddComponent( const std::string& aFileName, const std::string aRefDes,
     bool aBottom, DOUBLET aPosition, double aRotation,
-    TRIPLET aOffset, TRIPLET aOrientation )
+    TRIPLET aOffset, TRIPLET aOrientation, PCB_STAGE* aStage )
 {
-    // first retrieve a label
-    TDF_Label lmodel;
+    // calculate the Location transform
+    TopLoc_Location toploc;
 
-    if( !getModelLabel( aFileName, lmodel ) )
+    if( !getModelLocation( aBottom, aPosition, aRotation, aOffset, aOrientation, toploc ) )
     {
         std::ostringstream ostr;
         ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
-        ostr << "  * no model for filename '" << aFileName << "'\n";
+        ostr << "  * no location data for filename '" << aFileName << "'\n";
         wxLogMessage( "%s\n", ostr.str().c_str() );
         return false;
     }
 
-    // calculate the Location transform
-    TopLoc_Location toploc;
+    if( aStage )
+    {
+        COMPONENT_DATUM datum;
+        datum.m_filename = aFileName;
+        datum.m_refdes = aRefDes;
+        datum.m_location = toploc;
+        aStage->m_components.push_back( datum );
+        return true;
+    }
 
-    if( !getModelLocation( aBottom, aPosition, aRotation, aOffset, aOrientation, toploc ) )
+    return addComponent( aFileName, aRefDes, toploc );
+}
+
+
+bool PCBMODEL::addComponent( const std::string& aFileName, const std::string& aRefDes,
+    const TopLoc_Location& aLocation )
+{
+    if( m_boardOnly )
+        return false;
+
+    // first retrieve a label; the document is locked by getModelLabel()
+    // except while the model file is read
+    TDF_Label lmodel;
+
+    if( !getModelLabel( aFileName, lmodel ) )
     {
         std::ostringstream ostr;
         ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
-        ostr << "  * no location data for filename '" << aFileName << "'\n";
+        ostr << "  * no model for filename '" << aFileName << "'\n";
         wxLogMessage( "%s\n", ostr.str().c_str() );
         return false;
     }
 
+    // models are shared by all boards of a system assembly
+    std::unique_lock< std::mutex > lock = lockDocument();
+
     // add the located sub-assembly
-    TDF_Label llabel = m_assy->AddComponent( m_assy_label, lmodel, toploc );
+    TDF_Label llabel = m_assy->AddComponent( m_assy_label, lmodel, aLocation );
 
     if( llabel.IsNull() )
     {
@@ -598,11 +993,49 @@ bool PCBMODEL::AddComponent( const std::string& aFileName, const std::string aRe
     // attach the RefDes name
     TCollection_ExtendedString refdes( aRefDes.c_str() );
     TDataStd_Name::Set( llabel, refdes );
+    ( m_system ? m_system->m_modelRefs : m_modelRefs )[aFileName].push_back( aRefDes );
 
     return true;
 }
 
 
+bool PCBMODEL::CommitStage( PCB_STAGE& aStage )
+{
+    bool hasdata = false;
+
+    for( auto& i : aStage.m_curves )
+    {
+        if( addCurve( i ) )
+            hasdata = true;
+    }
+
+    if( !aStage.m_cutouts.empty() )
+    {
+        m_cutouts.insert( m_cutouts.end(), aStage.m_cutouts.begin(), aStage.m_cutouts.end() );
+        hasdata = true;
+    }
+
+    for( auto& i : aStage.m_components )
+    {
+        if( addComponent( i.m_filename, i.m_refdes, i.m_location ) )
+            hasdata = true;
+    }
+
+    if( !aStage.m_pads.empty() )
+    {
+        m_pads.insert( m_pads.end(), aStage.m_pads.begin(), aStage.m_pads.end() );
+        hasdata = true;
+    }
+
+    aStage.m_curves.clear();
+    aStage.m_cutouts.clear();
+    aStage.m_components.clear();
+    aStage.m_pads.clear();
+
+    return hasdata;
+}
+
+
 void PCBMODEL::SetPCBThickness( double aThickness )
 {
     if( aThickness < 0.0 )
@@ -616,172 +1049,1836 @@ void PCBMODEL::SetPCBThickness( double aThickness )
 }
 
 
-// create the PCB (board only) model using the current outlines and drill holes
-bool PCBMODEL::CreatePCB()
+void PCBMODEL::SetRegion( const BOX2D& aRegion )
 {
-    if( m_hasPCB )
-    {
-        if( m_pcb_label.IsNull() )
-            return false;
+    m_region = aRegion;
+    m_hasRegion = !aRegion.IsEmpty();
+    return;
+}
 
-        return true;
-    }
 
-    if( m_curves.empty() || m_mincurve == m_curves.end() )
-    {
-        m_hasPCB = true;
-        std::ostringstream ostr;
-        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
-        ostr << "  * no valid board outline\n";
-        wxLogMessage( "%s\n", ostr.str().c_str() );
-        return false;
-    }
+void PCBMODEL::SetBoardCache( const std::string& aFileName )
+{
+    m_boardCache = aFileName;
+    return;
+}
 
-    m_hasPCB = true;    // whether or not operations fail we note that CreatePCB has been invoked
-    TopoDS_Shape board;
-    OUTLINE oln;    // loop to assemble (represents PCB outline and cutouts)
-    oln.AddSegment( *m_mincurve );
-    m_curves.erase( m_mincurve );
 
-    while( !m_curves.empty() )
-    {
-        if( oln.IsClosed() )
-        {
-            if( board.IsNull() )
-            {
-                if( !oln.MakeShape( board, m_thickness ) )
-                {
-                    std::ostringstream ostr;
-                    ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
-                    ostr << "  * could not create board extrusion\n";
-                    wxLogMessage( "%s\n", ostr.str().c_str() );
+void PCBMODEL::SetThreadCount( unsigned aThreads )
+{
+    m_threads = aThreads;
+    return;
+}
+
+
+void PCBMODEL::InitThreadPool( unsigned aThreads )
+{
+#if OCC_VERSION_HEX >= 0x070400
+    // the boolean's parallel mode runs on the default thread pool
+    OSD_ThreadPool::DefaultPool()->Init( (int) GetThreadCount( aThreads ) );
+#endif
+    return;
+}
+
+
+void PCBMODEL::SetTileSize( double aSize )
+{
+    m_tileSize = aSize > 0.0 ? aSize : 0.0;
+    return;
+}
+
+
+void PCBMODEL::SetSimplifyTolerance( double aTolerance )
+{
+    m_simplify = aTolerance > 0.0 ? aTolerance : 0.0;
+    return;
+}
+
+
+void PCBMODEL::SetPanel( int aColumns, int aRows, const DOUBLET& aPitch, double aRail, double aTab )
+{
+    m_panelColumns = aColumns > 1 ? aColumns : 1;
+    m_panelRows = aRows > 1 ? aRows : 1;
+    m_panelPitch.x = aPitch.x > 0.0 ? aPitch.x : 0.0;
+    m_panelPitch.y = aPitch.y > 0.0 ? aPitch.y : 0.0;
+    m_panelRail = aRail > 0.0 ? aRail : 0.0;
+    m_panelTab = aTab > 0.0 ? aTab : 0.0;
+    return;
+}
+
+
+void PCBMODEL::SetProfiler( PROFILER* aProfiler )
+{
+    m_profiler = aProfiler;
+    return;
+}
+
+
+void PCBMODEL::SetModelCache( MODEL_CACHE* aCache )
+{
+    m_modelCache = aCache;
+    return;
+}
+
+
+uint64_t PCBMODEL::getBoardHash() const
+{
+    // the items are combined by summation so that the hash does not
+    // depend on the order in which the segments and cutouts were added
+    uint64_t sum = 0;
+
+    for( const auto& i : m_curves )
+    {
+        CURVE_KEY key = getCurveKey( i );
+        uint64_t hash = HashBytes( key.data(), key.size() * sizeof( int64_t ) );
+        sum += HashBytes( &hash, sizeof( hash ) );
+    }
+
+    for( const auto& i : m_cutouts )
+        sum += HashBytes( &i.m_key, sizeof( i.m_key ) );
+
+    int64_t params[7];
+    params[0] = MMToNM( m_thickness );
+    params[1] = m_hasRegion ? 1 : 0;
+    params[2] = m_hasRegion ? MMToNM( m_region.minx ) : 0;
+    params[3] = m_hasRegion ? MMToNM( m_region.miny ) : 0;
+    params[4] = m_hasRegion ? MMToNM( m_region.maxx ) : 0;
+    params[5] = m_hasRegion ? MMToNM( m_region.maxy ) : 0;
+    params[6] = MMToNM( m_simplify );
+
+    uint64_t hash = HashBytes( params, sizeof( params ) );
+    hash = HashBytes( &sum, sizeof( sum ), hash );
+    uint64_t ncurves = m_curves.size();
+    uint64_t ncutouts = m_cutouts.size();
+    hash = HashBytes( &ncurves, sizeof( ncurves ), hash );
+
+    return HashBytes( &ncutouts, sizeof( ncutouts ), hash );
+}
+
+
+bool PCBMODEL::readBoard( uint64_t aHash, TopoDS_Shape& aBoard )
+{
+    std::ifstream ifile( m_boardCache.c_str(), std::ios::in | std::ios::binary );
+
+    if( !ifile.is_open() )
+        return false;
+
+    std::string magic;
+    int version = 0;
+    uint64_t hash = 0;
+    ifile >> magic >> version >> std::hex >> hash >> std::dec;
+
+    if( !ifile || magic != BOARD_CACHE_MAGIC || version != BOARD_CACHE_VERSION || hash != aHash )
+        return false;
+
+    BRep_Builder builder;
+    BRepTools::Read( aBoard, ifile, builder );
+
+    if( aBoard.IsNull() )
+        return false;
+
+    return true;
+}
+
+
+bool PCBMODEL::writeBoard( uint64_t aHash, const TopoDS_Shape& aBoard )
+{
+    std::string tmpname = m_boardCache + ".tmp";
+    std::ofstream ofile( tmpname.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+
+    if( ofile.is_open() )
+    {
+        ofile << BOARD_CACHE_MAGIC << " " << BOARD_CACHE_VERSION << " ";
+        ofile << std::hex << aHash << std::dec << "\n";
+        BRepTools::Write( aBoard, ofile );
+        ofile.close();
+
+        if( !ofile.fail() && wxRenameFile( tmpname, m_boardCache, true ) )
+            return true;
+
+        wxRemoveFile( tmpname );
+    }
+
+    std::ostringstream ostr;
+    ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+    ostr << "  * could not write the board cache '" << m_boardCache << "'\n";
+    wxLogMessage( "%s\n", ostr.str().c_str() );
+
+    return false;
+}
+
+
+// create the PCB (board only) model using the current outlines and drill holes
+bool PCBMODEL::CreatePCB()
+{
+    if( m_hasPCB )
+    {
+        if( m_boardOnly )
+            return !m_board.IsNull();
+
+        if( m_pcb_label.IsNull() )
+            return false;
+
+        return true;
+    }
+
+    if( m_curves.empty() || m_mincurve == m_curves.end() )
+    {
+        m_hasPCB = true;
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+        ostr << "  * no valid board outline\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    m_hasPCB = true;    // whether or not operations fail we note that CreatePCB has been invoked
+    TopoDS_Shape board;
+
+    if( !m_boardCache.empty() )
+    {
+        uint64_t hash = getBoardHash();
+
+        if( !readBoard( hash, board ) )
+        {
+            board.Nullify();
+
+            if( !buildBoard( board ) )
+                return false;
+
+            writeBoard( hash, board );
+        }
+    }
+    else if( !buildBoard( board ) )
+    {
+        return false;
+    }
+
+    // the bare board is written directly; no assembly, names or colors
+    if( m_boardOnly )
+    {
+        m_board = board;
+        return true;
+    }
+
+    // the board solid is built concurrently with the other boards of a
+    // system assembly but the boards are added to the document one at a time
+    std::unique_lock< std::mutex > lock = lockDocument();
+
+    // push the board to the data structure
+    m_pcb_label = m_assy->AddComponent( m_assy_label, board );
+
+    if( m_pcb_label.IsNull() )
+        return false;
+
+    // color the PCB
+    Handle(XCAFDoc_ColorTool) color =
+        XCAFDoc_DocumentTool::ColorTool( m_doc->Main () );
+    Quantity_Color pcb_green( 0.06, 0.4, 0.06, Quantity_TOC_RGB );
+    color->SetColor( m_pcb_label, pcb_green, XCAFDoc_ColorSurf );
+
+    TopExp_Explorer topex;
+    topex.Init( m_assy->GetShape( m_pcb_label ), TopAbs_SOLID );
+
+    while( topex.More() )
+    {
+        color->SetColor( topex.Current(), pcb_green, XCAFDoc_ColorSurf );
+        topex.Next();
+    }
+
+    // failures of the copper layers are reported by addCopper() and addPads()
+    bool ok = true;
+
+    bool copper = false;
+
+    for( int i = 0; i < 2; ++i )
+    {
+        if( !m_copper[i].empty() || !m_copperShapes[i].empty() || m_copperFailed[i] > 0 )
+            copper = true;
+    }
+
+    if( copper && !addCopper() )
+        ok = false;
+
+    if( !m_pads.empty() && !addPads() )
+        ok = false;
+
+    if( m_panelColumns > 1 || m_panelRows > 1 || m_panelRail > 0.0 )
+        ok = makePanel( board ) && ok;
+
+    return ok;
+}
+
+
+bool PCBMODEL::AddCopper( const POLYGON_REGION& aRegion, bool aBottom )
+{
+    if( aRegion.m_outline.size() < 3 )
+        return false;
+
+    m_copper[aBottom ? 1 : 0].push_back( aRegion );
+    return true;
+}
+
+
+// create a closed wire through the points of a polygon at the height aZ
+static TopoDS_Wire makePolygonWire( const std::vector< DOUBLET >& aPolygon, double aZ )
+{
+    BRepBuilderAPI_MakePolygon poly;
+
+    for( const auto& i : aPolygon )
+        poly.Add( gp_Pnt( i.x, i.y, aZ ) );
+
+    poly.Close();
+
+    if( !poly.IsDone() )
+        return TopoDS_Wire();
+
+    return poly.Wire();
+}
+
+
+static Quantity_Color copperColor()
+{
+    return Quantity_Color( 0.72, 0.45, 0.2, Quantity_TOC_RGB );
+}
+
+
+// extrude a region by aThickness from the height aZ; polygons are built as
+// single wires so no edges are created one by one
+static TopoDS_Shape makeRegionShape( const POLYGON_REGION& aRegion, double aZ,
+    double aThickness )
+{
+    TopoDS_Wire outline = makePolygonWire( aRegion.m_outline, aZ );
+
+    if( outline.IsNull() )
+        return TopoDS_Shape();
+
+    BRepBuilderAPI_MakeFace face( gp_Pln( gp_Pnt( 0.0, 0.0, aZ ), gp_Dir( 0.0, 0.0, 1.0 ) ),
+        outline, Standard_True );
+
+    for( const auto& i : aRegion.m_holes )
+    {
+        TopoDS_Wire hole = makePolygonWire( i, aZ );
+
+        if( !hole.IsNull() )
+            face.Add( hole );
+    }
+
+    if( !face.IsDone() )
+        return TopoDS_Shape();
+
+    return BRepPrimAPI_MakePrism( face.Face(), gp_Vec( 0, 0, aThickness ) );
+}
+
+
+void PCBMODEL::BuildCopper()
+{
+    for( int side = 0; side < 2; ++side )
+    {
+        std::vector< POLYGON_REGION >& regions = m_copper[side];
+
+        if( regions.empty() )
+            continue;
+
+        double z = side ? -COPPER_THICKNESS : m_thickness;
+        std::vector< TopoDS_Shape > shapes( regions.size() );
+        std::vector< char > outside( regions.size(), 0 );
+
+        ParallelFor( regions.size(), m_threads, [&]( size_t aIndex )
+            {
+                shapes[aIndex] = makeRegionShape( regions[aIndex], z, COPPER_THICKNESS );
+
+                // regions which cross the edge of the export region are
+                // trimmed to it in the same way as the board
+                BOX2D box;
+
+                for( const auto& i : regions[aIndex].m_outline )
+                    box.Add( i.x, i.y );
+
+                if( m_hasRegion && !shapes[aIndex].IsNull() && !m_region.Contains( box ) )
+                {
+                    TopoDS_Shape tool = BRepPrimAPI_MakeBox(
+                        gp_Pnt( m_region.minx, m_region.miny, z - 1.0 ),
+                        gp_Pnt( m_region.maxx, m_region.maxy, z + 1.0 ) ).Shape();
+                    BRepAlgoAPI_Common common( shapes[aIndex], tool );
+
+                    if( !common.IsDone() )
+                        shapes[aIndex].Nullify();
+                    else if( !TopExp_Explorer( common.Shape(), TopAbs_SOLID ).More() )
+                        outside[aIndex] = 1;
+                    else
+                        shapes[aIndex] = common.Shape();
+                }
+
+                // zone fills may hold many points; release them as soon as possible
+                std::vector< DOUBLET >().swap( regions[aIndex].m_outline );
+                std::vector< std::vector< DOUBLET > >().swap( regions[aIndex].m_holes );
+            } );
+
+        for( size_t i = 0; i < shapes.size(); ++i )
+        {
+            if( outside[i] )
+                continue;
+
+            if( shapes[i].IsNull() )
+                ++m_copperFailed[side];
+            else
+                m_copperShapes[side].push_back( shapes[i] );
+        }
+
+        std::vector< POLYGON_REGION >().swap( regions );
+    }
+
+    return;
+}
+
+
+bool PCBMODEL::addCopper()
+{
+    PROFILE_SCOPE timer( m_profiler, "copper" );
+
+    // extrude any regions which were added since the last BuildCopper()
+    BuildCopper();
+
+    Handle( XCAFDoc_ColorTool ) color = XCAFDoc_DocumentTool::ColorTool( m_doc->Main() );
+    Quantity_Color copper = copperColor();
+    const char* names[2] = { "F.Cu", "B.Cu" };
+    bool ok = true;
+
+    for( int side = 0; side < 2; ++side )
+    {
+        if( m_copperFailed[side] > 0 )
+        {
+            std::ostringstream ostr;
+            ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+            ostr << "  * could not create " << m_copperFailed[side] << " copper regions on ";
+            ostr << names[side] << "\n";
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+            ok = false;
+        }
+
+        if( m_copperShapes[side].empty() )
+            continue;
+
+        TopoDS_Compound compound;
+        BRep_Builder builder;
+        builder.MakeCompound( compound );
+
+        for( auto& i : m_copperShapes[side] )
+            builder.Add( compound, i );
+
+        std::vector< TopoDS_Shape >().swap( m_copperShapes[side] );
+        TDF_Label label = m_assy->AddComponent( m_assy_label, compound );
+
+        if( label.IsNull() )
+        {
+            std::ostringstream ostr;
+            ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+            ostr << "  * could not add the copper of " << names[side] << " to the assembly\n";
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+            ok = false;
+            continue;
+        }
+
+        TDataStd_Name::Set( label, TCollection_ExtendedString( names[side] ) );
+        color->SetColor( label, copper, XCAFDoc_ColorSurf );
+    }
+
+    return ok;
+}
+
+
+// create the outline of a pad copper shape centered on the origin; the
+// corners are visited counterclockwise starting at the lower right and
+// the lines between rounded corners are dropped if they are degenerate
+static bool makePadOutline( const PAD_COPPER_KEY& aKey, OUTLINE& aOutline )
+{
+    double hx = 0.5 * NMToMM( aKey[1] );
+    double hy = 0.5 * NMToMM( aKey[2] );
+    double rad = NMToMM( aKey[3] );
+
+    if( PAD_CIRCLE == aKey[0] )
+    {
+        KICADCURVE crv;
+        crv.m_form = CURVE_CIRCLE;
+        crv.m_end = DOUBLET( hx, 0.0 );
+        crv.m_radius = hx;
+        return aOutline.AddSegment( crv );
+    }
+
+    // centers of the corner arcs and the directions of the arc end points
+    const double cx[4] = { hx - rad, hx - rad, rad - hx, rad - hx };
+    const double cy[4] = { rad - hy, hy - rad, hy - rad, rad - hy };
+    const double dx[5] = { 0.0, 1.0, 0.0, -1.0, 0.0 };
+    const double dy[5] = { -1.0, 0.0, 1.0, 0.0, -1.0 };
+
+    for( int i = 0; i < 4; ++i )
+    {
+        int next = ( i + 1 ) % 4;
+        DOUBLET p0( cx[i] + rad * dx[i], cy[i] + rad * dy[i] );
+        DOUBLET p1( cx[i] + rad * dx[i + 1], cy[i] + rad * dy[i + 1] );
+        DOUBLET p2( cx[next] + rad * dx[next], cy[next] + rad * dy[next] );
+
+        if( rad > 0.0 )
+        {
+            KICADCURVE arc;
+            arc.m_form = CURVE_ARC;
+            arc.m_start = DOUBLET( cx[i], cy[i] );
+            arc.m_end = p0;
+            arc.m_ep = p1;
+            arc.m_angle = M_PI_2;
+            arc.m_radius = rad;
+
+            if( !aOutline.AddSegment( arc ) )
+                return false;
+        }
+
+        double lx = p2.x - p1.x;
+        double ly = p2.y - p1.y;
+
+        if( lx * lx + ly * ly >= MIN_LENGTH2 )
+        {
+            KICADCURVE line;
+            line.m_form = CURVE_LINE;
+            line.m_start = p1;
+            line.m_end = p2;
+
+            if( !aOutline.AddSegment( line ) )
+                return false;
+        }
+    }
+
+    return aOutline.IsClosed();
+}
+
+
+bool PCBMODEL::getPadLabel( const PAD_COPPER_KEY& aKey, TDF_Label& aLabel )
+{
+    auto pad = m_padLabels.find( aKey );
+
+    if( pad != m_padLabels.end() )
+    {
+        aLabel = pad->second;
+        return !aLabel.IsNull();
+    }
+
+    // a failed shape is recorded so that it is only reported once
+    m_padLabels[aKey] = TDF_Label();
+
+    OUTLINE oln;
+    TopoDS_Wire outline;
+    std::vector< DOUBLET > polygon;
+
+    if( !makePadOutline( aKey, oln ) || !oln.MakeWire( outline ) )
+    {
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+        ostr << "  * could not create the outline of a pad of size ";
+        ostr << NMToMM( aKey[1] ) << " x " << NMToMM( aKey[2] ) << "\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    // on the XY plane the outer boundary must be counterclockwise
+    // and the inner boundary must be clockwise
+    oln.GetPolygon( polygon, ARC_DEVIATION );
+
+    if( PolygonArea( polygon ) < 0.0 )
+        outline.Reverse();
+
+    BRepBuilderAPI_MakeFace face( gp_Pln( gp_Pnt( 0.0, 0.0, 0.0 ), gp_Dir( 0.0, 0.0, 1.0 ) ),
+        outline, Standard_True );
+
+    if( aKey[4] > 0 )
+    {
+        std::shared_ptr< CUTOUT_PRIMITIVE > drill =
+            getHolePrimitive( NMToMM( aKey[4] ), NMToMM( aKey[5] ) );
+
+        if( drill )
+        {
+            TopoDS_Wire hole = drill->m_wire;
+
+            if( aKey[6] )
+            {
+                gp_Trsf lRot;
+                lRot.SetRotation( gp_Ax1( gp_Pnt( 0.0, 0.0, 0.0 ), gp_Dir( 0.0, 0.0, 1.0 ) ), M_PI_2 );
+                hole = TopoDS::Wire( hole.Moved( TopLoc_Location( lRot ) ) );
+            }
+
+            if( PolygonArea( drill->m_polygon ) > 0.0 )
+                hole.Reverse();
+
+            face.Add( hole );
+        }
+    }
+
+    if( !face.IsDone() )
+    {
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+        ostr << "  * could not create the face of a pad of size ";
+        ostr << NMToMM( aKey[1] ) << " x " << NMToMM( aKey[2] ) << "\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    TopoDS_Shape shape = BRepPrimAPI_MakePrism( face.Face(), gp_Vec( 0, 0, COPPER_THICKNESS ) );
+
+    if( shape.IsNull() )
+        return false;
+
+    aLabel = m_assy->AddShape( shape, Standard_False );
+
+    if( aLabel.IsNull() )
+        return false;
+
+    const char* forms[4] = { "RECT", "CIRCLE", "OVAL", "ROUNDRECT" };
+    std::ostringstream name;
+    name << "PAD_" << forms[aKey[0]] << "_" << NMToMM( aKey[1] ) << "x" << NMToMM( aKey[2] );
+
+    if( aKey[4] > 0 )
+        name << "_D" << NMToMM( aKey[4] );
+
+    TDataStd_Name::Set( aLabel, TCollection_ExtendedString( name.str().c_str() ) );
+
+    Handle( XCAFDoc_ColorTool ) color = XCAFDoc_DocumentTool::ColorTool( m_doc->Main() );
+    color->SetColor( aLabel, copperColor(), XCAFDoc_ColorSurf );
+    m_padLabels[aKey] = aLabel;
+
+    return true;
+}
+
+
+bool PCBMODEL::addPads()
+{
+    PROFILE_SCOPE timer( m_profiler, "pads" );
+
+    const char* names[2] = { "F.Pads", "B.Pads" };
+    TDF_Label sides[2];
+    double dlim = (double)std::numeric_limits< float >::epsilon();
+    size_t nfailed = 0;
+    bool ok = true;
+
+    for( const auto& i : m_pads )
+    {
+        TDF_Label label;
+
+        if( !getPadLabel( i.m_key, label ) )
+        {
+            ++nfailed;
+            continue;
+        }
+
+        int side = i.m_bottom ? 1 : 0;
+
+        if( sides[side].IsNull() )
+        {
+            sides[side] = m_assy->NewShape();
+            TDataStd_Name::Set( sides[side], TCollection_ExtendedString( names[side] ) );
+        }
+
+        gp_Trsf lPos;
+        lPos.SetTranslation( gp_Vec( i.m_position.x, i.m_position.y,
+            i.m_bottom ? -COPPER_THICKNESS : m_thickness ) );
+
+        if( i.m_angle < -dlim || i.m_angle > dlim )
+        {
+            gp_Trsf lRot;
+            lRot.SetRotation( gp_Ax1( gp_Pnt( 0.0, 0.0, 0.0 ), gp_Dir( 0.0, 0.0, 1.0 ) ), i.m_angle );
+            lPos.Multiply( lRot );
+        }
+
+        if( m_assy->AddComponent( sides[side], label, TopLoc_Location( lPos ) ).IsNull() )
+            ++nfailed;
+    }
+
+    if( nfailed > 0 )
+    {
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+        ostr << "  * could not place " << nfailed << " pads\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        ok = false;
+    }
+
+    for( int side = 0; side < 2; ++side )
+    {
+        if( sides[side].IsNull() )
+            continue;
+
+        if( m_assy->AddComponent( m_assy_label, sides[side], TopLoc_Location() ).IsNull() )
+            ok = false;
+    }
+
+    std::vector< PAD_COPPER >().swap( m_pads );
+    return ok;
+}
+
+
+bool PCBMODEL::makePanel( const TopoDS_Shape& aBoard )
+{
+    PROFILE_SCOPE timer( m_profiler, "panel" );
+
+    Bnd_Box bounds;
+    BRepBndLib::Add( aBoard, bounds );
+
+    if( bounds.IsVoid() )
+        return false;
+
+    double x0, y0, z0, x1, y1, z1;
+    bounds.Get( x0, y0, z0, x1, y1, z1 );
+
+    double pitchX = m_panelPitch.x > 0.0 ? m_panelPitch.x : x1 - x0 + PANEL_GAP;
+    double pitchY = m_panelPitch.y > 0.0 ? m_panelPitch.y : y1 - y0 + PANEL_GAP;
+    double gapX = pitchX - ( x1 - x0 );     // space between adjacent boards
+    double gapY = pitchY - ( y1 - y0 );
+    double railGap = gapY > 0.0 ? gapY : PANEL_GAP;
+    double panelX1 = x1 + ( m_panelColumns - 1 ) * pitchX;
+    double panelY1 = y1 + ( m_panelRows - 1 ) * pitchY;
+
+    TDataStd_Name::Set( m_assy_label, TCollection_ExtendedString( "BOARD" ) );
+    m_panel_label = m_assy->NewShape();
+    TDataStd_Name::Set( m_panel_label, TCollection_ExtendedString( "PANEL" ) );
+
+    for( int row = 0; row < m_panelRows; ++row )
+    {
+        for( int col = 0; col < m_panelColumns; ++col )
+        {
+            gp_Trsf lPos;
+            lPos.SetTranslation( gp_Vec( col * pitchX, row * pitchY, 0.0 ) );
+
+            if( m_assy->AddComponent( m_panel_label, m_assy_label,
+                TopLoc_Location( lPos ) ).IsNull() )
+            {
+                std::ostringstream ostr;
+                ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+                ostr << "  * could not place the board in the panel\n";
+                wxLogMessage( "%s\n", ostr.str().c_str() );
+                return false;
+            }
+        }
+    }
+
+    // the rails span the panel; the tabs cross the gaps between the extents
+    // of the boards at the middle of each side and reach the rails
+    std::vector< BOX2D > frame;
+    double cx = 0.5 * ( x0 + x1 );
+    double cy = 0.5 * ( y0 + y1 );
+    double ht = 0.5 * m_panelTab;
+
+    if( m_panelRail > 0.0 )
+    {
+        frame.push_back( BOX2D( x0, y0 - railGap - m_panelRail, panelX1, y0 - railGap ) );
+        frame.push_back( BOX2D( x0, panelY1 + railGap, panelX1, panelY1 + railGap + m_panelRail ) );
+    }
+
+    for( int row = 0; row < m_panelRows && m_panelTab > 0.0; ++row )
+    {
+        for( int col = 0; col < m_panelColumns; ++col )
+        {
+            double ox = col * pitchX;
+            double oy = row * pitchY;
+
+            if( col + 1 < m_panelColumns && gapX > 0.0 )
+                frame.push_back( BOX2D( x1 + ox, cy + oy - ht, x0 + ox + pitchX, cy + oy + ht ) );
+
+            if( row + 1 < m_panelRows && gapY > 0.0 )
+                frame.push_back( BOX2D( cx + ox - ht, y1 + oy, cx + ox + ht, y0 + oy + pitchY ) );
+
+            if( m_panelRail <= 0.0 )
+                continue;
+
+            if( 0 == row )
+                frame.push_back( BOX2D( cx + ox - ht, y0 - railGap, cx + ox + ht, y0 ) );
+
+            if( m_panelRows - 1 == row )
+                frame.push_back( BOX2D( cx + ox - ht, panelY1, cx + ox + ht, panelY1 + railGap ) );
+        }
+    }
+
+    if( frame.empty() )
+        return true;
+
+    TopoDS_Compound compound;
+    BRep_Builder builder;
+    builder.MakeCompound( compound );
+
+    for( const auto& i : frame )
+    {
+        builder.Add( compound, BRepPrimAPI_MakeBox( gp_Pnt( i.minx, i.miny, 0.0 ),
+            gp_Pnt( i.maxx, i.maxy, m_thickness ) ).Solid() );
+    }
+
+    TDF_Label label = m_assy->AddComponent( m_panel_label, compound );
+
+    if( label.IsNull() )
+        return false;
+
+    Handle( XCAFDoc_ColorTool ) color = XCAFDoc_DocumentTool::ColorTool( m_doc->Main() );
+    Quantity_Color pcb_green( 0.06, 0.4, 0.06, Quantity_TOC_RGB );
+    TDataStd_Name::Set( label, TCollection_ExtendedString( "FRAME" ) );
+    color->SetColor( label, pcb_green, XCAFDoc_ColorSurf );
+
+    return true;
+}
+
+
+// cell of the endpoint grid used to chain outline segments; the cell size equals
+// the coincidence tolerance so that coincident points lie in adjacent cells
+static NMPOINT getGridCell( double aX, double aY )
+{
+    static const double cellsize = sqrt( MIN_LENGTH2 );
+    return NMPOINT( (int64_t) std::floor( aX / cellsize ), (int64_t) std::floor( aY / cellsize ) );
+}
+
+
+bool PCBMODEL::chainLoops( std::vector< OUTLINE >& aLoops )
+{
+    // index the endpoints of all segments on a grid so that the segments
+    // which may attach to the end of a loop are found without a full scan
+    std::vector< KICADCURVE > curves;
+    std::vector< char > used;
+    std::unordered_map< NMPOINT, std::vector< size_t >, NMPOINT_HASH > grid;
+    size_t first = 0;
+
+    curves.reserve( m_curves.size() );
+
+    for( std::list< KICADCURVE >::iterator i = m_curves.begin(); i != m_curves.end(); ++i )
+    {
+        if( i == m_mincurve )
+            first = curves.size();
+
+        curves.push_back( *i );
+
+        if( CURVE_CIRCLE == i->m_form )
+            continue;
+
+        double spx, spy, epx, epy;
+        getEndPoints( *i, spx, spy, epx, epy );
+        grid[getGridCell( spx, spy )].push_back( curves.size() - 1 );
+
+        NMPOINT ec = getGridCell( epx, epy );
+
+        if( ec != getGridCell( spx, spy ) )
+            grid[ec].push_back( curves.size() - 1 );
+    }
+
+    m_curves.clear();
+    m_mincurve = m_curves.end();
+    used.resize( curves.size(), 0 );
+
+    // attach an unused segment near ( aX, aY ) to the loop
+    auto attach = [&]( OUTLINE& aLoop, double aX, double aY ) -> bool
+    {
+        NMPOINT cell = getGridCell( aX, aY );
+
+        for( int64_t dx = -1; dx <= 1; ++dx )
+        {
+            for( int64_t dy = -1; dy <= 1; ++dy )
+            {
+                auto bucket = grid.find( NMPOINT( cell.x + dx, cell.y + dy ) );
+
+                if( bucket == grid.end() )
+                    continue;
+
+                for( auto i : bucket->second )
+                {
+                    if( !used[i] && aLoop.AddSegment( curves[i] ) )
+                    {
+                        used[i] = 1;
+                        return true;
+                    }
+                }
+            }
+        }
+
+        return false;
+    };
+
+    // end points of loops which could not be closed
+    std::vector< std::pair< DOUBLET, DOUBLET > > openEnds;
+    size_t next = 0;    // lowest index which may be unused
+    size_t start = first;
+
+    while( start < curves.size() )
+    {
+        OUTLINE oln;
+        oln.AddSegment( curves[start] );
+        used[start] = 1;
+
+        while( !oln.IsClosed() )
+        {
+            double spx, spy, epx, epy;
+            getEndPoints( oln.m_curves.front(), spx, spy, epx, epy );
+
+            if( attach( oln, spx, spy ) )
+                continue;
+
+            getEndPoints( oln.m_curves.back(), spx, spy, epx, epy );
+
+            if( !attach( oln, epx, epy ) )
+                break;
+        }
+
+        if( oln.IsClosed() )
+        {
+            aLoops.push_back( oln );
+        }
+        else
+        {
+            double spx, spy, epx, epy, tx, ty;
+            getEndPoints( oln.m_curves.front(), spx, spy, tx, ty );
+            getEndPoints( oln.m_curves.back(), tx, ty, epx, epy );
+            openEnds.push_back( std::make_pair( DOUBLET( spx, spy ), DOUBLET( epx, epy ) ) );
+        }
+
+        while( next < curves.size() && used[next] )
+            ++next;
+
+        start = next;
+    }
+
+    if( openEnds.empty() )
+        return true;
+
+    // report all open loops at once; for each loop the nearest end of any
+    // open loop (including the other end of the same loop) is reported since
+    // this is usually a small gap in the outline
+    std::ostringstream ostr;
+    ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+    ostr << "  * could not close " << openEnds.size() << " outline(s); the outline data is dropped\n";
+
+    for( size_t i = 0; i < openEnds.size(); ++i )
+    {
+        const DOUBLET& p0 = openEnds[i].second;
+        DOUBLET p1 = openEnds[i].first;
+        double d2 = ( p1.x - p0.x ) * ( p1.x - p0.x ) + ( p1.y - p0.y ) * ( p1.y - p0.y );
+
+        for( size_t j = 0; j < openEnds.size(); ++j )
+        {
+            if( j == i )
+                continue;
+
+            const DOUBLET* ends[2] = { &openEnds[j].first, &openEnds[j].second };
+
+            for( int k = 0; k < 2; ++k )
+            {
+                double dx = ends[k]->x - p0.x;
+                double dy = ends[k]->y - p0.y;
+
+                if( dx * dx + dy * dy < d2 )
+                {
+                    d2 = dx * dx + dy * dy;
+                    p1 = *ends[k];
+                }
+            }
+        }
+
+        ostr << "    gap of " << sqrt( d2 ) << " mm between (" << p0.x << ", " << p0.y;
+        ostr << ") and (" << p1.x << ", " << p1.y << ")\n";
+    }
+
+    wxLogMessage( "%s\n", ostr.str().c_str() );
+    return false;
+}
+
+
+bool PCBMODEL::buildBoard( TopoDS_Shape& aBoard )
+{
+    // the first loop contains the leftmost feature and is the board outline;
+    // all other loops are cutouts
+    std::vector< OUTLINE > loops;
+    TopoDS_Wire outline;
+    std::vector< DOUBLET > polygon;
+
+    {
+        PROFILE_SCOPE timer( m_profiler, "board outline" );
+        chainLoops( loops );
+
+        if( m_simplify > 0.0 )
+        {
+            std::vector< size_t > counts( loops.size() );
+            size_t nold = 0;
+            size_t nnew = 0;
+
+            for( auto& i : loops )
+                nold += i.m_curves.size();
+
+            ParallelFor( loops.size(), m_threads, [&]( size_t aIndex )
+                {
+                    counts[aIndex] = loops[aIndex].Simplify( m_simplify );
+                } );
+
+            for( auto i : counts )
+                nnew += i;
+
+            if( nnew < nold )
+            {
+                std::ostringstream ostr;
+                ostr << "* simplified the board outlines from " << nold << " to ";
+                ostr << nnew << " segments\n";
+                wxLogMessage( "%s\n", ostr.str().c_str() );
+            }
+        }
+
+        if( !checkLoops( loops ) )
+            return false;
+
+        if( loops.empty() || !loops.front().MakeWire( outline ) )
+        {
+            std::ostringstream ostr;
+            ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+            ostr << "  * could not create board outline\n";
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+            return false;
+        }
+
+        loops.front().GetPolygon( polygon, ARC_DEVIATION );
+
+        // the cutout profiles are independent and are built concurrently;
+        // the results are gathered in loop order
+        std::vector< CUTOUT > holes( loops.size() - 1 );
+        std::vector< char > valid( holes.size(), false );
+
+        ParallelFor( holes.size(), m_threads, [&]( size_t aIndex )
+            {
+                OUTLINE& oln = loops[aIndex + 1];
+                CUTOUT& hole = holes[aIndex];
+
+                if( oln.MakeWire( hole.m_wire ) )
+                {
+                    oln.GetBoundingBox( hole.m_bbox );
+                    oln.GetPolygon( hole.m_polygon, ARC_DEVIATION );
+                    valid[aIndex] = true;
+                }
+            } );
+
+        // messages logged by worker threads are buffered until flushed
+        wxLog::FlushActive();
+
+        for( size_t i = 0; i < holes.size(); ++i )
+        {
+            if( valid[i] )
+            {
+                m_cutouts.push_back( holes[i] );
+            }
+            else
+            {
+                std::ostringstream ostr;
+                ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+                ostr << "  * could not create board cutout\n";
+                wxLogMessage( "%s\n", ostr.str().c_str() );
+            }
+        }
+    }
+
+    std::vector< size_t > cutlist;
+
+    if( m_hasRegion )
+    {
+        RTREE< size_t > index;
+
+        for( size_t i = 0; i < m_cutouts.size(); ++i )
+            index.Insert( m_cutouts[i].m_bbox, i );
+
+        index.Build();
+        index.Query( m_region, cutlist );
+
+        // retain the original order of the cutouts
+        std::sort( cutlist.begin(), cutlist.end() );
+    }
+    else
+    {
+        for( size_t i = 0; i < m_cutouts.size(); ++i )
+            cutlist.push_back( i );
+    }
+
+    // cutouts which are disjoint and lie within the outline are inner
+    // boundaries of a single board face which is extruded once; only
+    // the remaining cutouts are subtracted from the extruded board
+    std::vector< CUTOUT_CLASS > cutclass;
+    std::vector< size_t > facelist;
+    std::vector< size_t > boollist;
+    size_t ndropped = 0;
+
+    {
+        PROFILE_SCOPE timer( m_profiler, "classify cutouts" );
+        classifyCutouts( polygon, cutlist, cutclass );
+    }
+
+    for( size_t i = 0; i < cutlist.size(); ++i )
+    {
+        switch( cutclass[i] )
+        {
+            case CUTOUT_FACE:
+                facelist.push_back( cutlist[i] );
+                break;
+
+            case CUTOUT_BOOLEAN:
+                boollist.push_back( cutlist[i] );
+                break;
+
+            default:
+                ++ndropped;
+                break;
+        }
+    }
+
+    if( ndropped > 0 )
+    {
+        std::ostringstream ostr;
+        ostr << "* " << ndropped << " holes or cutouts outside the board or within ";
+        ostr << "other cutouts were ignored\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+    }
+
+    if( m_hasRegion || !buildFace( outline, polygon, facelist, aBoard ) )
+    {
+        // the board is trimmed to the region (or the face could not be
+        // created) so all cutouts which have an effect are subtracted
+        boollist.insert( boollist.end(), facelist.begin(), facelist.end() );
+        std::sort( boollist.begin(), boollist.end() );
+        aBoard.Nullify();
+
+        TopoDS_Face face = BRepBuilderAPI_MakeFace( outline );
+        aBoard = BRepPrimAPI_MakePrism( face, gp_Vec( 0, 0, m_thickness ) );
+
+        if( aBoard.IsNull() )
+        {
+            std::ostringstream ostr;
+            ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+            ostr << "  * could not create board extrusion\n";
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+            return false;
+        }
+    }
+
+    if( m_hasRegion )
+    {
+        // trim the board to the region before subtracting the cutouts
+        // so that the booleans only operate on the exported area
+        TopoDS_Shape box = BRepPrimAPI_MakeBox( gp_Pnt( m_region.minx, m_region.miny, -m_thickness ),
+            gp_Pnt( m_region.maxx, m_region.maxy, 2.0 * m_thickness ) ).Shape();
+        aBoard = BRepAlgoAPI_Common( aBoard, box );
+
+        if( aBoard.IsNull() || !TopExp_Explorer( aBoard, TopAbs_SOLID ).More() )
+        {
+            std::ostringstream ostr;
+            ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+            ostr << "  * the export region does not intersect the board\n";
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+            return false;
+        }
+    }
+
+    return cutHoles( aBoard, boollist );
+}
+
+
+bool PCBMODEL::checkLoops( const std::vector< OUTLINE >& aLoops )
+{
+    std::vector< std::vector< DOUBLET > > polygons( aLoops.size() );
+
+    for( size_t i = 0; i < aLoops.size(); ++i )
+        aLoops[i].GetPolygon( polygons[i], CHECK_DEVIATION );
+
+    POLYGON_CONTACT contact;
+    std::vector< int > parent;
+
+    if( FindPolygonContact( polygons, contact, parent ) )
+    {
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+
+        if( contact.m_polygon0 == contact.m_polygon1 )
+        {
+            ostr << "  * the " << ( contact.m_polygon0 ? "cutout" : "board" );
+            ostr << " outline intersects itself";
+        }
+        else
+        {
+            if( contact.m_polygon0 && contact.m_polygon1 )
+                ostr << "  * two cutouts intersect";
+            else
+                ostr << "  * the board outline intersects a cutout";
+        }
+
+        ostr << " at (" << contact.m_point.x << ", " << contact.m_point.y << ")\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    // the first loop is the board; all other loops should lie directly within it
+    for( size_t i = 1; i < polygons.size(); ++i )
+    {
+        if( parent[i] == 0 )
+            continue;
+
+        std::ostringstream ostr;
+        ostr << "* the cutout at (" << polygons[i].front().x << ", " << polygons[i].front().y;
+        ostr << ") lies " << ( parent[i] < 0 ? "outside the board" : "within another cutout" );
+        ostr << " and has no effect\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+    }
+
+    return true;
+}
+
+
+void PCBMODEL::classifyCutouts( const std::vector< DOUBLET >& aOutline,
+    const std::vector< size_t >& aCutList, std::vector< CUTOUT_CLASS >& aClass ) const
+{
+    // the polygons are inscribed in the true profiles so the
+    // separation must exceed the deviation of both polygons
+    const double clearance = 2.0 * ARC_DEVIATION + USER_PREC;
+    const double clearance2 = clearance * clearance;
+    const size_t ncut = aCutList.size();
+    const size_t board = ncut;      // owner index of the outline edges
+
+    aClass.assign( ncut, CUTOUT_BOOLEAN );
+
+    if( aOutline.size() < 3 )
+        return;
+
+    BOX2D outlineBox;
+
+    for( const auto& i : aOutline )
+        outlineBox.Add( i.x, i.y );
+
+    outlineBox.Inflate( clearance );
+
+    // drop tools which lie entirely outside the board's box and exact
+    // duplicates such as a via placed on a pad with the same drill
+    std::vector< char > active( ncut, true );
+    std::unordered_set< uint64_t > keys;
+
+    for( size_t i = 0; i < ncut; ++i )
+    {
+        const CUTOUT& cut = m_cutouts[aCutList[i]];
+
+        if( !cut.m_bbox.Intersects( outlineBox ) )
+        {
+            aClass[i] = CUTOUT_DROP;
+            active[i] = false;
+        }
+        else if( cut.m_key && !keys.insert( cut.m_key ).second )
+        {
+            aClass[i] = CUTOUT_DROP;
+            active[i] = false;
+        }
+        else if( cut.m_polygon.size() < 3 )
+        {
+            active[i] = false;
+        }
+    }
 
-                    return false;
-                }
+    struct EDGE
+    {
+        size_t  owner;
+        DOUBLET p0;
+        DOUBLET p1;
+    };
+
+    std::vector< EDGE > edges;
+    RTREE< size_t > index;
+
+    auto addEdges = [&]( const std::vector< DOUBLET >& aPolygon, size_t aOwner )
+    {
+        for( size_t i = 0, j = aPolygon.size() - 1; i < aPolygon.size(); j = i++ )
+        {
+            EDGE edge;
+            edge.owner = aOwner;
+            edge.p0 = aPolygon[j];
+            edge.p1 = aPolygon[i];
+
+            BOX2D box( edge.p0.x, edge.p0.y, edge.p1.x, edge.p1.y );
+            box.Inflate( clearance );
+            index.Insert( box, edges.size() );
+            edges.push_back( edge );
+        }
+    };
+
+    addEdges( aOutline, board );
+
+    for( size_t i = 0; i < ncut; ++i )
+    {
+        if( active[i] )
+            addEdges( m_cutouts[aCutList[i]].m_polygon, i );
+    }
+
+    index.Build();
+
+    // find the tools whose boundaries touch or cross the outline or another tool
+    std::vector< char > crossesBoard( ncut, false );
+    std::vector< char > crossesCutout( ncut, false );
+    std::vector< size_t > found;
+
+    for( size_t i = 0; i < edges.size(); ++i )
+    {
+        const EDGE& edge = edges[i];
+        BOX2D box( edge.p0.x, edge.p0.y, edge.p1.x, edge.p1.y );
+        found.clear();
+        index.Query( box, found );
+
+        for( auto j : found )
+        {
+            const EDGE& other = edges[j];
+
+            if( j <= i || other.owner == edge.owner )
+                continue;
+
+            if( SegmentDistance2( edge.p0, edge.p1, other.p0, other.p1 ) >= clearance2 )
+                continue;
+
+            if( board == edge.owner )
+            {
+                crossesBoard[other.owner] = true;
+            }
+            else if( board == other.owner )
+            {
+                crossesBoard[edge.owner] = true;
             }
             else
             {
-                TopoDS_Shape hole;
-
-                if( oln.MakeShape( hole, m_thickness ) )
-                {
-                    m_cutouts.push_back( hole );
-                }
-                else
-                {
-                    std::ostringstream ostr;
-                    ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
-                    ostr << "  * could not create board cutout\n";
-                    wxLogMessage( "%s\n", ostr.str().c_str() );
-                }
+                crossesCutout[edge.owner] = true;
+                crossesCutout[other.owner] = true;
             }
+        }
+    }
 
-            oln.Clear();
+    // a tool whose boundary meets nothing lies entirely inside or
+    // outside the board and entirely inside or outside any other tool
+    RTREE< size_t > holes;
 
-            if( !m_curves.empty() )
-            {
-                oln.AddSegment( m_curves.front() );
-                m_curves.pop_front();
-            }
+    for( size_t i = 0; i < ncut; ++i )
+    {
+        if( active[i] )
+            holes.Insert( m_cutouts[aCutList[i]].m_bbox, i );
+    }
+
+    holes.Build();
+
+    for( size_t i = 0; i < ncut; ++i )
+    {
+        if( !active[i] || crossesBoard[i] )
+            continue;
 
+        const DOUBLET& pt = m_cutouts[aCutList[i]].m_polygon.front();
+
+        if( !PointInPolygon( pt, aOutline ) )
+        {
+            aClass[i] = CUTOUT_DROP;
             continue;
         }
 
-        std::list< KICADCURVE >::iterator sC = m_curves.begin();
-        std::list< KICADCURVE >::iterator eC = m_curves.end();
+        if( crossesCutout[i] )
+            continue;
+
+        aClass[i] = CUTOUT_FACE;
+        found.clear();
+        holes.Query( BOX2D( pt.x, pt.y, pt.x, pt.y ), found );
 
-        while( sC != eC )
+        for( auto j : found )
         {
-            if( oln.AddSegment( *sC ) )
+            if( j != i && PointInPolygon( pt, m_cutouts[aCutList[j]].m_polygon ) )
             {
-                m_curves.erase( sC );
+                // the tool removes nothing which the enclosing tool does not
+                aClass[i] = CUTOUT_DROP;
                 break;
             }
-
-            ++sC;
         }
+    }
+
+    return;
+}
+
+
+bool PCBMODEL::buildFace( const TopoDS_Wire& aOutline, const std::vector< DOUBLET >& aPolygon,
+    const std::vector< size_t >& aHoles, TopoDS_Shape& aBoard )
+{
+    PROFILE_SCOPE timer( m_profiler, "board face" );
+
+    // on the XY plane the outer boundary must be counterclockwise
+    // and the inner boundaries must be clockwise
+    TopoDS_Wire outline = aOutline;
+
+    if( PolygonArea( aPolygon ) < 0.0 )
+        outline.Reverse();
+
+    BRepBuilderAPI_MakeFace face( gp_Pln( gp_Pnt( 0.0, 0.0, 0.0 ), gp_Dir( 0.0, 0.0, 1.0 ) ),
+        outline, Standard_True );
+
+    for( auto i : aHoles )
+    {
+        TopoDS_Wire hole = m_cutouts[i].m_wire;
+
+        if( PolygonArea( m_cutouts[i].m_polygon ) > 0.0 )
+            hole.Reverse();
+
+        face.Add( hole );
+    }
+
+    if( !face.IsDone() )
+    {
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+        ostr << "  * could not create the board face; the cutouts will be subtracted from the board\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    aBoard = BRepPrimAPI_MakePrism( face.Face(), gp_Vec( 0, 0, m_thickness ) );
+
+    return !aBoard.IsNull();
+}
+
+
+bool PCBMODEL::cutTiles( TopoDS_Shape& aBoard, const std::vector< size_t >& aCutList )
+{
+#if OCC_VERSION_HEX < 0x070100
+    // the tiles share the board and the tools and are only cut concurrently
+    // by the non-destructive booleans of OCCT 7.1 and later
+    return false;
+#else
+    Bnd_Box bounds;
+    BRepBndLib::Add( aBoard, bounds );
+
+    if( bounds.IsVoid() )
+        return false;
+
+    double x0, y0, z0, x1, y1, z1;
+    bounds.Get( x0, y0, z0, x1, y1, z1 );
+
+    size_t nx = (size_t) std::max( 1.0, std::ceil( ( x1 - x0 ) / m_tileSize ) );
+    size_t ny = (size_t) std::max( 1.0, std::ceil( ( y1 - y0 ) / m_tileSize ) );
+
+    if( nx * ny < 2 )
+        return false;
+
+    // adjacent tiles are bounded by the same coordinates so that the tiles
+    // fit exactly; the outer tiles extend beyond the board
+    std::vector< double > xs( nx + 1 );
+    std::vector< double > ys( ny + 1 );
+
+    for( size_t i = 0; i <= nx; ++i )
+        xs[i] = x0 + m_tileSize * i;
+
+    for( size_t i = 0; i <= ny; ++i )
+        ys[i] = y0 + m_tileSize * i;
+
+    xs.front() -= 1.0;
+    ys.front() -= 1.0;
+    xs.back() = std::max( xs.back(), x1 ) + 1.0;
+    ys.back() = std::max( ys.back(), y1 ) + 1.0;
+
+    // the tools were created in advance since the tiles share them
+    RTREE< size_t > index;
+
+    for( auto i : aCutList )
+    {
+        if( !m_cutouts[i].m_shape.IsNull() )
+            index.Insert( m_cutouts[i].m_bbox, i );
+    }
+
+    index.Build();
+
+    std::vector< TopoDS_Shape > tiles( nx * ny );
+    std::atomic< bool > failed( false );
+
+    {
+        PROFILE_SCOPE timer( m_profiler, "cut tiles" );
+
+        ParallelFor( tiles.size(), m_threads, [&]( size_t aIndex )
+            {
+                if( failed )
+                    return;
+
+                size_t ix = aIndex % nx;
+                size_t iy = aIndex / nx;
+                BOX2D tbox( xs[ix], ys[iy], xs[ix + 1], ys[iy + 1] );
+
+                TopTools_ListOfShape args;
+                TopTools_ListOfShape tools;
+                args.Append( aBoard );
+                tools.Append( BRepPrimAPI_MakeBox( gp_Pnt( tbox.minx, tbox.miny, z0 - 1.0 ),
+                    gp_Pnt( tbox.maxx, tbox.maxy, z1 + 1.0 ) ).Shape() );
+
+                BRepAlgoAPI_Common common;
+                common.SetArguments( args );
+                common.SetTools( tools );
+                common.SetNonDestructive( true );
+                common.SetRunParallel( false );
+                common.Build();
+
+                if( !common.IsDone() )
+                {
+                    failed = true;
+                    return;
+                }
+
+                TopoDS_Shape tile = common.Shape();
+
+                // the tile lies outside the board
+                if( tile.IsNull() || !TopExp_Explorer( tile, TopAbs_SOLID ).More() )
+                    return;
+
+                std::vector< size_t > found;
+                index.Query( tbox, found );
+
+                if( !found.empty() )
+                {
+                    std::sort( found.begin(), found.end() );
+                    args.Clear();
+                    tools.Clear();
+                    args.Append( tile );
+
+                    for( auto i : found )
+                        tools.Append( m_cutouts[i].m_shape );
+
+                    BRepAlgoAPI_Cut cut;
+                    cut.SetArguments( args );
+                    cut.SetTools( tools );
+                    cut.SetNonDestructive( true );
+                    cut.SetRunParallel( false );
+                    cut.Build();
+
+                    if( !cut.IsDone() )
+                    {
+                        failed = true;
+                        return;
+                    }
+
+                    tile = cut.Shape();
+                }
+
+                tiles[aIndex] = tile;
+            } );
+    }
+
+    if( failed )
+    {
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+        ostr << "  * could not cut the board tiles; the board will be cut as a whole\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    PROFILE_SCOPE timer( m_profiler, "glue tiles" );
+
+    // the tiles only meet at shared faces so they are fused with the
+    // glue option and the faces which were split by the tiles are merged
+    TopTools_ListOfShape args;
+    TopTools_ListOfShape tools;
+
+    for( auto& i : tiles )
+    {
+        if( i.IsNull() )
+            continue;
+
+        if( args.IsEmpty() )
+            args.Append( i );
+        else
+            tools.Append( i );
+    }
+
+    if( args.IsEmpty() )
+        return false;
 
-        if( sC == eC && !oln.m_curves.empty() )
+    TopoDS_Shape board;
+
+    if( tools.IsEmpty() )
+    {
+        board = args.First();
+    }
+    else
+    {
+        BRepAlgoAPI_Fuse fuse;
+        fuse.SetArguments( args );
+        fuse.SetTools( tools );
+        fuse.SetGlue( BOPAlgo_GlueShift );
+        fuse.SetRunParallel( m_threads != 1 );
+        fuse.Build();
+
+        if( !fuse.IsDone() || fuse.Shape().IsNull() )
         {
             std::ostringstream ostr;
             ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
-            ostr << "  * could not close outline (dropping outline data with " << oln.m_curves.size() << " segments)\n";
+            ostr << "  * could not glue the board tiles; the board will be cut as a whole\n";
             wxLogMessage( "%s\n", ostr.str().c_str() );
-            oln.Clear();
-
-            if( !m_curves.empty() )
-            {
-                oln.AddSegment( m_curves.front() );
-                m_curves.pop_front();
-            }
+            return false;
         }
+
+        board = fuse.Shape();
     }
 
-    if( oln.IsClosed() )
+    ShapeUpgrade_UnifySameDomain unify( board, Standard_True, Standard_True, Standard_False );
+    unify.Build();
+    aBoard = unify.Shape();
+
+    return true;
+#endif
+}
+
+
+// extrude a profile into a cutting tool which extends beyond both faces of the board
+static bool makeToolShape( const TopoDS_Wire& aWire, double aThickness, TopoDS_Shape& aTool )
+{
+    TopoDS_Face face = BRepBuilderAPI_MakeFace( aWire );
+    TopoDS_Shape tool = BRepPrimAPI_MakePrism( face, gp_Vec( 0, 0, aThickness * 2.0 ) );
+
+    if( tool.IsNull() )
+        return false;
+
+    gp_Trsf shift;
+    shift.SetTranslation( gp_Vec( 0.0, 0.0, -aThickness * 0.5 ) );
+    aTool = BRepBuilderAPI_Transform( tool, shift ).Shape();
+
+    return !aTool.IsNull();
+}
+
+
+bool PCBMODEL::makeTool( CUTOUT& aCutout )
+{
+    if( !aCutout.m_shape.IsNull() )
+        return true;
+
+    if( !aCutout.m_primitive )
+        return makeToolShape( aCutout.m_wire, m_thickness, aCutout.m_shape );
+
+    // holes of the same size are instances of one tool which
+    // is created by makeTools() before the instances are placed
+    if( aCutout.m_primitive->m_tool.IsNull() )
+        return false;
+
+    aCutout.m_shape = aCutout.m_primitive->m_tool.Moved( aCutout.m_location );
+
+    return true;
+}
+
+
+void PCBMODEL::makeTools( const std::vector< size_t >& aCutList )
+{
+    PROFILE_SCOPE timer( m_profiler, "cutting tools" );
+
+    // the shared tools are created first so that the workers only read them
+    for( auto& i : m_primitives )
     {
-        if( board.IsNull() )
+        if( i.second->m_tool.IsNull() )
+            makeToolShape( i.second->m_wire, m_thickness, i.second->m_tool );
+    }
+
+    ParallelFor( aCutList.size(), m_threads, [&]( size_t aIndex )
         {
-            if( !oln.MakeShape( board, m_thickness ) )
-            {
-                std::ostringstream ostr;
-                ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
-                ostr << "  * could not create board extrusion\n";
-                wxLogMessage( "%s\n", ostr.str().c_str() );
-                return false;
-            }
+            makeTool( m_cutouts[aCutList[aIndex]] );
+        } );
+
+    return;
+}
+
+
+bool PCBMODEL::cutHoles( TopoDS_Shape& aBoard, const std::vector< size_t >& aCutList )
+{
+    if( aCutList.empty() )
+        return true;
+
+    makeTools( aCutList );
+
+    if( m_tileSize > 0.0 && cutTiles( aBoard, aCutList ) )
+        return true;
+
+    PROFILE_SCOPE timer( m_profiler, "cut holes" );
+
+#if OCC_VERSION_HEX >= 0x060900
+    // all cutouts are subtracted at once so that the board is intersected
+    // with every tool in a single pass rather than rebuilt once per hole
+    TopTools_ListOfShape args;
+    TopTools_ListOfShape tools;
+    args.Append( aBoard );
+
+    for( auto i : aCutList )
+    {
+        if( !m_cutouts[i].m_shape.IsNull() )
+            tools.Append( m_cutouts[i].m_shape );
+    }
+
+    // the boolean's parallel mode runs on the default thread pool, which
+    // is sized once by InitThreadPool()
+    BRepAlgoAPI_Cut cut;
+    cut.SetArguments( args );
+    cut.SetTools( tools );
+    cut.SetRunParallel( m_threads != 1 );
+    cut.Build();
+
+    if( !cut.IsDone() || cut.Shape().IsNull() )
+    {
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+        ostr << "  * could not subtract " << aCutList.size() << " cutouts from the board\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    aBoard = cut.Shape();
+#else
+    for( auto i : aCutList )
+    {
+        if( !m_cutouts[i].m_shape.IsNull() )
+            aBoard = BRepAlgoAPI_Cut( aBoard, m_cutouts[i].m_shape );
+    }
+#endif
+
+    return true;
+}
+
+
+bool PCBMODEL::CheckShapes()
+{
+    if( m_pcb_label.IsNull() && m_boardLabels.empty() && m_board.IsNull() )
+    {
+        std::ostringstream ostr;
+        ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
+        ostr << "  * No valid PCB assembly; cannot check shapes\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
+        return false;
+    }
+
+    PROFILE_SCOPE timer( m_profiler, "check shapes" );
+
+    // each solid is checked separately so that large models are
+    // spread over the threads; a model without solids is checked whole
+    struct CHECK_JOB
+    {
+        const std::string*  m_filename;     // model file; NULL for the board
+        const std::string*  m_board;        // name of a board of a system assembly
+        int                 m_index;        // index of the solid within the model
+        TopoDS_Shape        m_shape;
+    };
+
+    std::vector< CHECK_JOB > jobs;
+
+    auto addJobs = [&]( const std::string* aFileName, const std::string* aBoard,
+        const TopoDS_Shape& aShape )
+    {
+        int index = 0;
+
+        for( TopExp_Explorer topex( aShape, TopAbs_SOLID ); topex.More(); topex.Next() )
+        {
+            CHECK_JOB job;
+            job.m_filename = aFileName;
+            job.m_board = aBoard;
+            job.m_index = index++;
+            job.m_shape = topex.Current();
+            jobs.push_back( job );
         }
-        else
+
+        if( 0 == index && !aShape.IsNull() )
         {
-            TopoDS_Shape hole;
+            CHECK_JOB job;
+            job.m_filename = aFileName;
+            job.m_board = aBoard;
+            job.m_index = -1;
+            job.m_shape = aShape;
+            jobs.push_back( job );
+        }
+    };
 
-            if( oln.MakeShape( hole, m_thickness ) )
-            {
-                m_cutouts.push_back( hole );
-            }
-            else
-            {
-                std::ostringstream ostr;
-                ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
-                ostr << "  * could not create board cutout\n";
-                wxLogMessage( "%s\n", ostr.str().c_str() );
-            }
+    if( m_boardOnly )
+        addJobs( NULL, NULL, m_board );
+    else if( !m_pcb_label.IsNull() )
+        addJobs( NULL, NULL, m_assy->GetShape( m_pcb_label ) );
+
+    for( auto& i : m_boardLabels )
+        addJobs( NULL, &i.first, m_assy->GetShape( i.second ) );
+
+    for( auto& i : *m_modelMap )
+        addJobs( &i.first, NULL, m_assy->GetShape( i.second ) );
+
+    std::vector< char > valid( jobs.size(), 0 );
+
+    ParallelFor( jobs.size(), m_threads, [&]( size_t aIndex )
+        {
+            BRepCheck_Analyzer analyzer( jobs[aIndex].m_shape );
+            valid[aIndex] = analyzer.IsValid() ? 1 : 0;
+        } );
+
+    wxLog::FlushActive();
+
+    size_t nInvalid = 0;
+
+    for( size_t i = 0; i < jobs.size(); ++i )
+    {
+        if( valid[i] )
+            continue;
+
+        ++nInvalid;
+        std::ostringstream ostr;
+
+        if( NULL == jobs[i].m_filename )
+        {
+            ostr << "* invalid board solid";
+
+            if( jobs[i].m_index >= 0 )
+                ostr << " " << jobs[i].m_index;
+
+            if( jobs[i].m_board )
+                ostr << " in board '" << *jobs[i].m_board << "'";
+
+            ostr << "\n";
+            wxLogMessage( "%s\n", ostr.str().c_str() );
+            continue;
         }
-    }
 
-    // subtract cutouts (if any)
-    for( auto i : m_cutouts )
-        board = BRepAlgoAPI_Cut( board, i );
+        ostr << "* invalid ";
 
-    // push the board to the data structure
-    m_pcb_label = m_assy->AddComponent( m_assy_label, board );
+        if( jobs[i].m_index < 0 )
+            ostr << "shape";
+        else
+            ostr << "solid " << jobs[i].m_index;
 
-    if( m_pcb_label.IsNull() )
-        return false;
+        ostr << " in model '" << *jobs[i].m_filename << "'";
 
-    // color the PCB
-    Handle(XCAFDoc_ColorTool) color =
-        XCAFDoc_DocumentTool::ColorTool( m_doc->Main () );
-    Quantity_Color pcb_green( 0.06, 0.4, 0.06, Quantity_TOC_RGB );
-    color->SetColor( m_pcb_label, pcb_green, XCAFDoc_ColorSurf );
+        auto refs = m_modelRefs.find( *jobs[i].m_filename );
 
-    TopExp_Explorer topex;
-    topex.Init( m_assy->GetShape( m_pcb_label ), TopAbs_SOLID );
+        if( refs != m_modelRefs.end() )
+        {
+            ostr << " used by";
 
-    while( topex.More() )
-    {
-        color->SetColor( topex.Current(), pcb_green, XCAFDoc_ColorSurf );
-        topex.Next();
+            for( auto& j : refs->second )
+                ostr << " " << j;
+        }
+
+        ostr << "\n";
+        wxLogMessage( "%s\n", ostr.str().c_str() );
     }
 
-    return true;
+    std::ostringstream ostr;
+    ostr << "* checked " << jobs.size() << " shapes, " << nInvalid << " invalid\n";
+    wxLogMessage( "%s\n", ostr.str().c_str() );
+
+    return 0 == nInvalid;
 }
 
 
 #ifdef SUPPORTS_IGES
+// fill in the global section of an IGES file
+static void setIgesHeader( IGESControl_Writer& aWriter, const std::string& aFileName )
+{
+    wxFileName fn( aFileName );
+    IGESData_GlobalSection header = aWriter.Model()->GlobalSection();
+    header.SetFileName( new TCollection_HAsciiString( fn.GetFullName().ToUTF8() ) );
+    header.SetSendName( new TCollection_HAsciiString( "KiCad electronic assembly" ) );
+    header.SetAuthorName( new TCollection_HAsciiString( Interface_Static::CVal( "write.iges.header.author" ) ) );
+    header.SetCompanyName( new TCollection_HAsciiString( Interface_Static::CVal( "write.iges.header.company" ) ) );
+    aWriter.Model()->SetGlobalSection( header );
+    return;
+}
+
+
 // write the assembly model in IGES format
 bool PCBMODEL::WriteIGES( const std::string& aFileName, bool aOverwrite )
 {
-    if( m_pcb_label.IsNull() )
+    if( m_pcb_label.IsNull() && m_boardLabels.empty() && m_board.IsNull() )
     {
         std::ostringstream ostr;
         ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
@@ -790,17 +2887,22 @@ bool PCBMODEL::WriteIGES( const std::string& aFileName, bool aOverwrite )
         return false;
     }
 
-    wxFileName fn( aFileName );
     IGESControl_Controller::Init();
+
+    // the bare board is transferred as a single shape without XCAF data
+    if( m_boardOnly )
+    {
+        IGESControl_Writer writer;
+        setIgesHeader( writer, aFileName );
+        writer.AddShape( m_board );
+        writer.ComputeModel();
+        return writer.Write( aFileName.c_str() ) ? true : false;
+    }
+
     IGESCAFControl_Writer writer;
     writer.SetColorMode( Standard_True );
     writer.SetNameMode( Standard_True );
-    IGESData_GlobalSection header = writer.Model()->GlobalSection();
-    header.SetFileName( new TCollection_HAsciiString( fn.GetFullName().ToUTF8() ) );
-    header.SetSendName( new TCollection_HAsciiString( "KiCad electronic assembly" ) );
-    header.SetAuthorName( new TCollection_HAsciiString( Interface_Static::CVal( "write.iges.header.author" ) ) );
-    header.SetCompanyName( new TCollection_HAsciiString( Interface_Static::CVal( "write.iges.header.company" ) ) );
-    writer.Model()->SetGlobalSection( header );
+    setIgesHeader( writer, aFileName );
 
     if( Standard_False == writer.Perform( m_doc, aFileName.c_str() ) )
         return false;
@@ -810,10 +2912,25 @@ bool PCBMODEL::WriteIGES( const std::string& aFileName, bool aOverwrite )
 #endif
 
 
+// fill in the header of a STEP file
+static void setStepHeader( STEPControl_Writer& aWriter, const std::string& aFileName )
+{
+    APIHeaderSection_MakeHeader hdr( aWriter.Model() );
+    wxFileName fn( aFileName );
+    hdr.SetName( new TCollection_HAsciiString( fn.GetFullName().ToUTF8() ) );
+    // TODO: how to control and ensure consistency with IGES?
+    hdr.SetAuthorValue( 1, new TCollection_HAsciiString( "An Author" ) );
+    hdr.SetOrganizationValue( 1, new TCollection_HAsciiString( "A Company" ) );
+    hdr.SetOriginatingSystem( new TCollection_HAsciiString( "KiCad to STEP converter" ) );
+    hdr.SetDescriptionValue( 1, new TCollection_HAsciiString( "KiCad electronic assembly" ) );
+    return;
+}
+
+
 // write the assembly model in STEP format
 bool PCBMODEL::WriteSTEP( const std::string& aFileName, bool aOverwrite )
 {
-    if( m_pcb_label.IsNull() )
+    if( m_pcb_label.IsNull() && m_boardLabels.empty() && m_board.IsNull() )
     {
         std::ostringstream ostr;
         ostr << __FILE__ << ": " << __FUNCTION__ << ": " << __LINE__ << "\n";
@@ -822,6 +2939,18 @@ bool PCBMODEL::WriteSTEP( const std::string& aFileName, bool aOverwrite )
         return false;
     }
 
+    // the bare board is transferred as a single shape without XCAF data
+    if( m_boardOnly )
+    {
+        STEPControl_Writer writer;
+
+        if( IFSelect_RetDone != writer.Transfer( m_board, STEPControl_AsIs ) )
+            return false;
+
+        setStepHeader( writer, aFileName );
+        return IFSelect_RetDone == writer.Write( aFileName.c_str() );
+    }
+
     STEPCAFControl_Writer writer;
     writer.SetColorMode( Standard_True );
     writer.SetNameMode( Standard_True );
@@ -829,14 +2958,7 @@ bool PCBMODEL::WriteSTEP( const std::string& aFileName, bool aOverwrite )
     if( Standard_False == writer.Transfer( m_doc, STEPControl_AsIs ) )
         return false;
 
-    APIHeaderSection_MakeHeader hdr( writer.ChangeWriter().Model() );
-    wxFileName fn( aFileName );
-    hdr.SetName( new TCollection_HAsciiString( fn.GetFullName().ToUTF8() ) );
-    // TODO: how to control and ensure consistency with IGES?
-    hdr.SetAuthorValue( 1, new TCollection_HAsciiString( "An Author" ) );
-    hdr.SetOrganizationValue( 1, new TCollection_HAsciiString( "A Company" ) );
-    hdr.SetOriginatingSystem( new TCollection_HAsciiString( "KiCad to STEP converter" ) );
-    hdr.SetDescriptionValue( 1, new TCollection_HAsciiString( "KiCad electronic assembly" ) );
+    setStepHeader( writer.ChangeWriter(), aFileName );
 
     if( Standard_False == writer.Write( aFileName.c_str() ) )
         return false;
@@ -847,9 +2969,13 @@ bool PCBMODEL::WriteSTEP( const std::string& aFileName, bool aOverwrite )
 
 bool PCBMODEL::getModelLabel( const std::string aFileName, TDF_Label& aLabel )
 {
-    MODEL_MAP::const_iterator mm = m_models.find( aFileName );
+    // the model map and the document are shared by the boards of a system
+    // assembly; the lock is released while the model file is read so that
+    // the boards may read their models concurrently
+    std::unique_lock< std::mutex > lock = lockDocument();
+    MODEL_MAP::const_iterator mm = m_modelMap->find( aFileName );
 
-    if( mm != m_models.end() )
+    if( mm != m_modelMap->end() )
     {
         aLabel = mm->second;
         return true;
@@ -858,8 +2984,15 @@ bool PCBMODEL::getModelLabel( const std::string aFileName, TDF_Label& aLabel )
     aLabel.Nullify();
 
     Handle( TDocStd_Document )  doc;
+
+    if( m_modelCache && m_modelCache->Find( aFileName, doc ) )
+        return transferLabel( aFileName, doc, aLabel );
+
     m_app->NewDocument( "MDTV-XCAF", doc );
 
+    if( lock.owns_lock() )
+        lock.unlock();
+
     FormatType modelFmt = fileType( aFileName.c_str() );
 
     switch( modelFmt )
@@ -892,6 +3025,29 @@ bool PCBMODEL::getModelLabel( const std::string aFileName, TDF_Label& aLabel )
             return false;
     }
 
+    if( lock.mutex() )
+        lock.lock();
+
+    // another board may have transferred the same model in the meantime
+    mm = m_modelMap->find( aFileName );
+
+    if( mm != m_modelMap->end() )
+    {
+        aLabel = mm->second;
+        doc->Close();
+        return true;
+    }
+
+    if( m_modelCache )
+        m_modelCache->Add( aFileName, doc );
+
+    return transferLabel( aFileName, doc, aLabel );
+}
+
+
+bool PCBMODEL::transferLabel( const std::string& aFileName, Handle( TDocStd_Document )& doc,
+    TDF_Label& aLabel )
+{
     aLabel = transferModel( doc, m_doc );
 
     if( aLabel.IsNull() )
@@ -910,7 +3066,7 @@ bool PCBMODEL::getModelLabel( const std::string aFileName, TDF_Label& aLabel )
     TCollection_ExtendedString partname( pname.c_str() );
     TDataStd_Name::Set( aLabel, partname );
 
-    m_models.insert( MODEL_DATUM( aFileName, aLabel ) );
+    m_modelMap->insert( MODEL_DATUM( aFileName, aLabel ) );
     ++m_components;
     return true;
 }
@@ -1156,6 +3312,67 @@ TDF_Label PCBMODEL::transferModel( Handle( TDocStd_Document )& source,
 }
 
 
+MODEL_CACHE::MODEL_CACHE()
+{
+    return;
+}
+
+
+MODEL_CACHE::~MODEL_CACHE()
+{
+    for( auto& i : m_docs )
+        i.second->Close();
+
+    return;
+}
+
+
+bool MODEL_CACHE::Find( const std::string& aFileName, Handle( TDocStd_Document )& aDoc ) const
+{
+    std::map< std::string, Handle( TDocStd_Document ) >::const_iterator doc =
+        m_docs.find( aFileName );
+
+    if( doc == m_docs.end() )
+        return false;
+
+    aDoc = doc->second;
+    return true;
+}
+
+
+void MODEL_CACHE::Add( const std::string& aFileName, Handle( TDocStd_Document )& aDoc )
+{
+    Remove( aFileName );
+    m_docs[aFileName] = aDoc;
+    return;
+}
+
+
+void MODEL_CACHE::Remove( const std::string& aFileName )
+{
+    std::map< std::string, Handle( TDocStd_Document ) >::iterator doc =
+        m_docs.find( aFileName );
+
+    if( doc == m_docs.end() )
+        return;
+
+    doc->second->Close();
+    m_docs.erase( doc );
+    return;
+}
+
+
+void MODEL_CACHE::GetFileNames( std::vector< std::string >& aFileNames ) const
+{
+    aFileNames.clear();
+
+    for( auto& i : m_docs )
+        aFileNames.push_back( i.first );
+
+    return;
+}
+
+
 OUTLINE::OUTLINE()
 {
     m_closed = false;
@@ -1262,16 +3479,240 @@ bool OUTLINE::AddSegment( const KICADCURVE& aCurve )
 }
 
 
-bool OUTLINE::MakeShape( TopoDS_Shape& aShape, double aThickness )
+void OUTLINE::GetBoundingBox( BOX2D& aBox ) const
 {
-    if( !aShape.IsNull() )
-        return false;   // there is already data in the shape object
+    aBox = BOX2D();
 
-    if( m_curves.empty() )
-        return true;    // suceeded in doing nothing
+    for( const auto& i : m_curves )
+    {
+        if( CURVE_LINE == i.m_form )
+        {
+            aBox.Add( i.m_start.x, i.m_start.y );
+            aBox.Add( i.m_end.x, i.m_end.y );
+        }
+        else
+        {
+            // arcs and circles are bounded by the full circle
+            aBox.Add( BOX2D( i.m_start.x - i.m_radius, i.m_start.y - i.m_radius,
+                i.m_start.x + i.m_radius, i.m_start.y + i.m_radius ) );
+        }
+    }
 
-    if( !m_closed )
-        return false;   // the loop is not closed
+    return;
+}
+
+
+void OUTLINE::GetPolygon( std::vector< DOUBLET >& aPolygon, double aDeviation ) const
+{
+    aPolygon.clear();
+
+    // each curve contributes its start point and the interior points of arcs;
+    // the end point of each curve is the start point of the next
+    auto addArc = [&]( const DOUBLET& aCenter, const DOUBLET& aStart, double aAngle, double aRadius )
+    {
+        int nseg = ArcSegments( aRadius, aAngle, aDeviation );
+        double a0 = atan2( aStart.y - aCenter.y, aStart.x - aCenter.x );
+        aPolygon.push_back( aStart );
+
+        for( int i = 1; i < nseg; ++i )
+        {
+            double ang = a0 + aAngle * i / nseg;
+            aPolygon.push_back( DOUBLET( aCenter.x + aRadius * cos( ang ),
+                aCenter.y + aRadius * sin( ang ) ) );
+        }
+    };
+
+    for( const auto& i : m_curves )
+    {
+        switch( i.m_form )
+        {
+            case CURVE_LINE:
+                aPolygon.push_back( i.m_start );
+                break;
+
+            case CURVE_ARC:
+                addArc( i.m_start, i.m_end, i.m_angle, i.m_radius );
+                break;
+
+            case CURVE_CIRCLE:
+                addArc( i.m_start, DOUBLET( i.m_start.x + i.m_radius, i.m_start.y ),
+                    2.0 * M_PI, i.m_radius );
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return;
+}
+
+
+// test whether the points aPoints[aFirst..aLast] lie on a circular arc within
+// aTolerance; on success the center and the subtended angle are returned
+static bool fitArc( const std::vector< DOUBLET >& aPoints, size_t aFirst, size_t aLast,
+    double aTolerance, DOUBLET& aCenter, double& aAngle )
+{
+    // the circle through the end points and the middle point; the end
+    // points are exactly on the circle so that the arc meets its neighbors
+    if( !CircleCenter( aPoints[aFirst], aPoints[( aFirst + aLast ) / 2], aPoints[aLast], aCenter ) )
+        return false;
+
+    double dx = aPoints[aFirst].x - aCenter.x;
+    double dy = aPoints[aFirst].y - aCenter.y;
+    double rad = sqrt( dx * dx + dy * dy );
+    double sum = 0.0;
+
+    for( size_t i = aFirst; i < aLast; ++i )
+    {
+        DOUBLET v0( aPoints[i].x - aCenter.x, aPoints[i].y - aCenter.y );
+        DOUBLET v1( aPoints[i + 1].x - aCenter.x, aPoints[i + 1].y - aCenter.y );
+
+        if( std::fabs( sqrt( v1.x * v1.x + v1.y * v1.y ) - rad ) > aTolerance )
+            return false;
+
+        // the points must advance monotonically around the center
+        double inc = atan2( v0.x * v1.y - v0.y * v1.x, v0.x * v1.x + v0.y * v1.y );
+
+        if( inc == 0.0 || ( sum != 0.0 && ( inc > 0.0 ) != ( sum > 0.0 ) ) )
+            return false;
+
+        sum += inc;
+
+        // the chord may not deviate from the arc by more than the tolerance
+        dx = aPoints[i + 1].x - aPoints[i].x;
+        dy = aPoints[i + 1].y - aPoints[i].y;
+        double hc2 = 0.25 * ( dx * dx + dy * dy );
+
+        if( hc2 > rad * rad || rad - sqrt( rad * rad - hc2 ) > aTolerance )
+            return false;
+    }
+
+    if( std::fabs( sum ) >= 2.0 * M_PI - USER_ANGLE_PREC )
+        return false;
+
+    aAngle = sum;
+    return true;
+}
+
+
+size_t OUTLINE::Simplify( double aTolerance )
+{
+    if( aTolerance <= 0.0 || m_curves.size() < 3 )
+        return m_curves.size();
+
+    std::list< KICADCURVE > curves;
+    std::vector< DOUBLET > pts;     // vertices of the current run of lines
+
+    // replace a run of lines by the longest straight or circular
+    // sections which remain within the tolerance
+    auto flushRun = [&]()
+    {
+        size_t nseg = pts.size() - 1;
+        size_t i = 0;
+
+        while( i < nseg )
+        {
+            size_t jmax = std::min( nseg, i + MAX_SIMPLIFY_RUN );
+            size_t jline = i + 1;
+
+            while( jline < jmax )
+            {
+                bool straight = true;
+
+                for( size_t k = i + 1; k <= jline && straight; ++k )
+                {
+                    if( PointDistance2( pts[k], pts[i], pts[jline + 1] ) > aTolerance * aTolerance )
+                        straight = false;
+                }
+
+                if( !straight )
+                    break;
+
+                ++jline;
+            }
+
+            size_t jarc = 0;
+            DOUBLET center;
+            double angle = 0.0;
+
+            for( size_t j = i + MIN_ARC_SEGMENTS; j <= jmax; ++j )
+            {
+                DOUBLET c;
+                double a;
+
+                if( !fitArc( pts, i, j, aTolerance, c, a ) )
+                    break;
+
+                jarc = j;
+                center = c;
+                angle = a;
+            }
+
+            KICADCURVE crv;
+            crv.m_layer = LAYER_EDGE;
+
+            if( jarc > jline )
+            {
+                double dx = pts[i].x - center.x;
+                double dy = pts[i].y - center.y;
+
+                crv.m_form = CURVE_ARC;
+                crv.m_start = center;
+                crv.m_end = pts[i];
+                crv.m_ep = pts[jarc];
+                crv.m_radius = sqrt( dx * dx + dy * dy );
+                crv.m_angle = angle;
+                crv.m_startangle = atan2( dy, dx );
+                crv.m_endangle = crv.m_startangle + angle;
+                i = jarc;
+            }
+            else
+            {
+                crv.m_form = CURVE_LINE;
+                crv.m_start = pts[i];
+                crv.m_end = pts[jline];
+                i = jline;
+            }
+
+            crv.m_nmStart = ToNM( crv.m_start );
+            crv.m_nmEnd = ToNM( crv.m_end );
+            curves.push_back( crv );
+        }
+
+        pts.clear();
+    };
+
+    for( const auto& i : m_curves )
+    {
+        if( CURVE_LINE != i.m_form )
+        {
+            if( !pts.empty() )
+                flushRun();
+
+            curves.push_back( i );
+            continue;
+        }
+
+        if( pts.empty() )
+            pts.push_back( i.m_start );
+
+        pts.push_back( i.m_end );
+    }
+
+    if( !pts.empty() )
+        flushRun();
+
+    m_curves.swap( curves );
+
+    return m_curves.size();
+}
+
+
+bool OUTLINE::MakeWire( TopoDS_Wire& aWire )
+{
+    if( m_curves.empty() || !m_closed )
+        return false;
 
     BRepBuilderAPI_MakeWire wire;
     DOUBLET lastPoint;
@@ -1289,6 +3730,27 @@ bool OUTLINE::MakeShape( TopoDS_Shape& aShape, double aThickness )
         }
     }
 
+    aWire = wire.Wire();
+    return true;
+}
+
+
+bool OUTLINE::MakeShape( TopoDS_Shape& aShape, double aThickness )
+{
+    if( !aShape.IsNull() )
+        return false;   // there is already data in the shape object
+
+    if( m_curves.empty() )
+        return true;    // suceeded in doing nothing
+
+    if( !m_closed )
+        return false;   // the loop is not closed
+
+    TopoDS_Wire wire;
+
+    if( !MakeWire( wire ) )
+        return false;
+
     TopoDS_Face face = BRepBuilderAPI_MakeFace( wire );
     aShape = BRepPrimAPI_MakePrism( face, gp_Vec( 0, 0, aThickness ) );
 
@@ -1328,8 +3790,10 @@ bool OUTLINE::addEdge( BRepBuilderAPI_MakeWire* aWire, KICADCURVE& aCurve, DOUBL
                 gp_Pnt sa( aLastPoint.x, aLastPoint.y, 0.0 );
                 gp_Pnt ea( endPoint.x, endPoint.y, 0.0 );
 
+                // the edge is oriented along the loop so that the
+                // wire follows the same direction as the curves
                 if( aCurve.m_angle < 0.0 )
-                    edge = BRepBuilderAPI_MakeEdge( arc, ea, sa );
+                    edge = TopoDS::Edge( BRepBuilderAPI_MakeEdge( arc, ea, sa ).Edge().Reversed() );
                 else
                     edge = BRepBuilderAPI_MakeEdge( arc, sa, ea );
 
@@ -24,12 +24,18 @@
 #ifndef OCE_VIS_OCE_UTILS_H
 #define OCE_VIS_OCE_UTILS_H
 
+#include <array>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include "base.h"
+#include "geom2d.h"
 #include "kicadpcb.h"
 #include "kicadcurve.h"
 
@@ -37,14 +43,128 @@
 #include <TDocStd_Document.hxx>
 #include <XCAFApp_Application.hxx>
 #include <XCAFDoc_ShapeTool.hxx>
+#include <TopLoc_Location.hxx>
 #include <TopoDS_Shape.hxx>
 #include <TopoDS_Edge.hxx>
+#include <TopoDS_Wire.hxx>
 
 
 typedef std::pair< std::string, TDF_Label > MODEL_DATUM;
 typedef std::map< std::string, TDF_Label > MODEL_MAP;
 
+// exact (nanometer) key of an outline segment; a segment and its reverse share a key
+typedef std::array< int64_t, 8 > CURVE_KEY;
+
+struct CURVE_KEY_HASH
+{
+    size_t operator()( const CURVE_KEY& aKey ) const
+    {
+        return (size_t) HashBytes( aKey.data(), aKey.size() * sizeof( int64_t ) );
+    }
+};
+
 class KICADPAD;
+class PROFILER;
+
+
+// a component placement which has been computed but not yet added to the assembly
+struct COMPONENT_DATUM
+{
+    std::string     m_filename;     // resolved model file name
+    std::string     m_refdes;       // reference designator
+    TopLoc_Location m_location;     // placement of the model
+};
+
+
+// profile of a drill or slot centered on the origin; one primitive is shared
+// by all holes of the same size and each hole is placed by a location
+struct CUTOUT_PRIMITIVE
+{
+    TopoDS_Wire             m_wire;     // profile in the XY plane
+    std::vector< DOUBLET >  m_polygon;  // approximation of the profile for 2D checks
+    TopoDS_Shape            m_tool;     // cutting tool (NULL until required)
+};
+
+// key of a hole primitive: length, width (nm)
+typedef std::array< int64_t, 2 > CUTOUT_PRIMITIVE_KEY;
+
+
+// a hole, slot or board cutout; the profile is kept in 2D so that the board
+// can be built as a single face and the cutting tool is only created if the
+// cutout must be subtracted from the board
+struct CUTOUT
+{
+    TopoDS_Shape    m_shape;    // cutting tool (may be NULL until required)
+    TopoDS_Wire     m_wire;     // profile in the XY plane
+    std::vector< DOUBLET > m_polygon;   // approximation of the profile for 2D checks
+    BOX2D           m_bbox;
+    uint64_t        m_key;      // hash of the parameters which define the shape
+    std::shared_ptr< CUTOUT_PRIMITIVE > m_primitive;    // shared profile (NULL = none)
+    TopLoc_Location m_location; // placement of the shared profile
+
+    CUTOUT() : m_key( 0 ) { return; }
+};
+
+
+// treatment of a cutout by the board construction
+enum CUTOUT_CLASS
+{
+    CUTOUT_DROP,        // outside the board, duplicated or within another cutout
+    CUTOUT_FACE,        // within the board and disjoint; an inner boundary of the board face
+    CUTOUT_BOOLEAN      // crosses the outline or another cutout; subtracted from the board
+};
+
+
+// key of a pad copper shape: form, size X, size Y, corner radius, drill length,
+// drill width (nm) and drill orientation (0 = along X, 1 = along Y)
+typedef std::array< int64_t, 7 > PAD_COPPER_KEY;
+
+
+// the copper of a pad in final position; one shape is shared by all pads
+// with the same key and each pad is placed by a location
+struct PAD_COPPER
+{
+    PAD_COPPER_KEY  m_key;
+    DOUBLET         m_position;
+    double          m_angle;    // rotation (radians)
+    bool            m_bottom;   // set true for copper on B.Cu
+};
+
+
+// per-module staging area; data is built independently of the PCBMODEL
+// (and hence may be built on a worker thread) and is added to the model
+// by PCBMODEL::CommitStage()
+struct PCB_STAGE
+{
+    std::list< KICADCURVE >         m_curves;       // validated outline segments
+    std::vector< CUTOUT >           m_cutouts;      // pad holes and slots
+    std::vector< COMPONENT_DATUM >  m_components;   // placed models
+    std::vector< PAD_COPPER >       m_pads;         // pad copper instances
+};
+
+
+// source documents of the models which have been read; the cache may be
+// shared by successive PCBMODELs so that a resident process reads each
+// model file only once
+class MODEL_CACHE
+{
+private:
+    std::map< std::string, Handle( TDocStd_Document ) > m_docs;
+
+public:
+    MODEL_CACHE();
+    virtual ~MODEL_CACHE();
+
+    bool Find( const std::string& aFileName, Handle( TDocStd_Document )& aDoc ) const;
+    void Add( const std::string& aFileName, Handle( TDocStd_Document )& aDoc );
+
+    // discard the cached model (for example when the model file has changed)
+    void Remove( const std::string& aFileName );
+
+    // retrieve the names of all cached model files
+    void GetFileNames( std::vector< std::string >& aFileNames ) const;
+};
+
 
 class OUTLINE
 {
@@ -69,6 +189,21 @@ public:
         return m_closed;
     }
 
+    // retrieve a box which encloses all segments of the outline
+    void GetBoundingBox( BOX2D& aBox ) const;
+
+    // retrieve a polygon which follows the loop in order and whose
+    // chords deviate from the arcs by no more than aDeviation
+    void GetPolygon( std::vector< DOUBLET >& aPolygon, double aDeviation ) const;
+
+    // replace runs of line segments by fewer lines and arcs which deviate
+    // from the segments' vertices by no more than aTolerance; the end points
+    // of the runs are retained. Returns the new number of curves
+    size_t Simplify( double aTolerance );
+
+    // create a wire in the XY plane which follows the loop in order
+    bool MakeWire( TopoDS_Wire& aWire );
+
     bool MakeShape( TopoDS_Shape& aShape, double aThickness );
 };
 
@@ -82,18 +217,137 @@ class PCBMODEL
     bool                            m_hasPCB;       // set true if CreatePCB() has been invoked
     TDF_Label                       m_pcb_label;    // label for the PCB model
     MODEL_MAP                       m_models;       // map of file names to model labels
+    MODEL_MAP*                      m_modelMap;     // m_models or the map of the system assembly
+    PCBMODEL*                       m_system;       // system assembly sharing the document (NULL = none)
+    std::mutex                      m_docLock;      // serializes the boards' access to a shared document
+    std::vector< std::pair< std::string, TDF_Label > > m_boardLabels;    // board solids of a system assembly
+    bool                            m_boardOnly;    // set true to build the bare board without a document
+    TopoDS_Shape                    m_board;        // board solid of a board-only model
+    std::map< std::string, std::vector< std::string > > m_modelRefs;  // RefDes of the users of each model
+    MODEL_CACHE*                    m_modelCache;   // optional cache of model documents
     int                             m_components;   // number of successfully loaded components;
     double                          m_precision;    // model (length unit) numeric precision
     double                          m_angleprec;    // angle numeric precision
     double                          m_thickness;    // PCB thickness, mm
     double                          m_minx;         // minimum X value in curves (leftmost curve feature)
     std::list< KICADCURVE >::iterator m_mincurve;   // iterator to the leftmost curve
+    bool                            m_hasRegion;    // set true if the output is limited to m_region
+    BOX2D                           m_region;       // exported area of the board
+    std::string                     m_boardCache;   // file holding the board solid of a previous run
+    unsigned                        m_threads;      // threads used by the booleans (0 = hardware threads)
+    PROFILER*                       m_profiler;     // optional timing of the board construction
+    double                          m_tileSize;     // size of the boolean tiles, mm (0 = no tiles)
+    double                          m_simplify;     // outline simplification tolerance, mm (0 = none)
+    int                             m_panelColumns; // boards along X in a panel
+    int                             m_panelRows;    // boards along Y in a panel
+    DOUBLET                         m_panelPitch;   // distance between the boards of a panel, mm (0 = automatic)
+    double                          m_panelRail;    // width of the panel rails, mm (0 = none)
+    double                          m_panelTab;     // width of the panel tabs, mm (0 = none)
+    TDF_Label                       m_panel_label;  // label for the panel (NULL = no panel)
 
     std::list< KICADCURVE >     m_curves;
-    std::vector< TopoDS_Shape > m_cutouts;
+    std::vector< CUTOUT >       m_cutouts;
+    std::vector< POLYGON_REGION > m_copper[2];  // copper regions awaiting extrusion on the top and bottom
+    std::vector< TopoDS_Shape > m_copperShapes[2];  // extruded copper regions
+    size_t                      m_copperFailed[2];  // number of regions which could not be extruded
+    std::vector< PAD_COPPER >   m_pads;         // pad copper instances
+    std::map< PAD_COPPER_KEY, TDF_Label > m_padLabels;  // shared pad copper shapes
+    std::unordered_set< CURVE_KEY, CURVE_KEY_HASH > m_curveKeys;  // keys of all outline segments
+
+    // hole primitives keyed by size; the map may be accessed by the staging threads
+    std::map< CUTOUT_PRIMITIVE_KEY, std::shared_ptr< CUTOUT_PRIMITIVE > > m_primitives;
+    std::mutex                  m_primitiveLock;
 
+    // retrieve the primitive of a hole of the given size (mm) aligned
+    // with the X axis; a round hole has aLength == aWidth
+    std::shared_ptr< CUTOUT_PRIMITIVE > getHolePrimitive( double aLength, double aWidth );
+
+    // set the primitive, location, wire and polygon of a hole of the given
+    // size (mm) centered on aPosition and rotated by aAngle (radians)
+    bool placeHole( const DOUBLET& aPosition, double aLength, double aWidth,
+        double aAngle, CUTOUT& aCutout );
+
+    // retrieve the label of a model, reading the file if necessary; takes
+    // the document lock itself but releases it while the file is read
     bool getModelLabel( const std::string aFileName, TDF_Label& aLabel );
 
+    // lock the document shared with the system assembly; the lock
+    // is empty if the document is not shared
+    std::unique_lock< std::mutex > lockDocument();
+
+    // transfer a model document into the assembly and record its label
+    bool transferLabel( const std::string& aFileName, Handle( TDocStd_Document )& doc,
+        TDF_Label& aLabel );
+
+    // assemble the outline segments into closed loops; the loop with the
+    // leftmost feature is first. Segments which do not form closed loops
+    // are dropped and all gaps are reported; returns false if there are gaps
+    bool chainLoops( std::vector< OUTLINE >& aLoops );
+
+    // create the board solid from the outlines and cutouts
+    bool buildBoard( TopoDS_Shape& aBoard );
+
+    // check the closed loops for self-intersections, intersections with other
+    // loops and nesting before any solids are created; returns false if the
+    // loops intersect. The first loop must be the board outline
+    bool checkLoops( const std::vector< OUTLINE >& aLoops );
+
+    // classify the listed cutouts against the board outline aOutline; aClass
+    // receives one entry per item of aCutList
+    void classifyCutouts( const std::vector< DOUBLET >& aOutline,
+        const std::vector< size_t >& aCutList, std::vector< CUTOUT_CLASS >& aClass ) const;
+
+    // create the board as a single face bounded by aOutline with the listed
+    // cutouts as inner boundaries; the cutouts must be classified CUTOUT_FACE
+    bool buildFace( const TopoDS_Wire& aOutline, const std::vector< DOUBLET >& aPolygon,
+        const std::vector< size_t >& aHoles, TopoDS_Shape& aBoard );
+
+    // create the cutting tool of a cutout if it does not exist; the tool
+    // of a shared primitive must already exist
+    bool makeTool( CUTOUT& aCutout );
+
+    // create the cutting tools of the listed cutouts concurrently
+    void makeTools( const std::vector< size_t >& aCutList );
+
+    // subtract the listed cutouts from the board in a single boolean operation
+    bool cutHoles( TopoDS_Shape& aBoard, const std::vector< size_t >& aCutList );
+
+    // split the board into tiles of m_tileSize, subtract the cutouts from each
+    // tile on a separate thread and glue the tiles; returns false if the board
+    // was not tiled, in which case aBoard is unchanged
+    bool cutTiles( TopoDS_Shape& aBoard, const std::vector< size_t >& aCutList );
+
+    // add the extruded copper regions to the assembly
+    // as one compound per side of the board
+    bool addCopper();
+
+    // retrieve the label of the shared copper shape of the pads with the
+    // key aKey; the shape is created and colored on first use
+    bool getPadLabel( const PAD_COPPER_KEY& aKey, TDF_Label& aLabel );
+
+    // place an instance of the shared pad shapes for each pad copper
+    // in one sub-assembly per side of the board
+    bool addPads();
+
+    // place copies of the board assembly in a panel together with the rails
+    // and tabs; the extent of aBoard is the outline used for the frame
+    bool makePanel( const TopoDS_Shape& aBoard );
+
+    // hash of all data which determines the board solid
+    uint64_t getBoardHash() const;
+
+    // read or write the board solid cache; the cached solid is
+    // only used if it was created from data with the hash aHash
+    bool readBoard( uint64_t aHash, TopoDS_Shape& aBoard );
+    bool writeBoard( uint64_t aHash, const TopoDS_Shape& aBoard );
+
+    // append a validated outline segment and track the leftmost feature
+    bool addCurve( const KICADCURVE& aCurve );
+
+    // add a model with a precomputed placement to the assembly
+    bool addComponent( const std::string& aFileName, const std::string& aRefDes,
+        const TopLoc_Location& aLocation );
+
     bool getModelLocation( bool aBottom, DOUBLET aPosition, double aRotation,
         TRIPLET aOffset, TRIPLET aOrientation, TopLoc_Location& aLocation );
 
@@ -104,19 +358,59 @@ class PCBMODEL
         Handle( TDocStd_Document )& dest );
 
 public:
-    PCBMODEL();
+    // if aSystem is not NULL the board is built in the document of the system
+    // assembly and shares its models with the other boards of the system;
+    // the boards may then be composed concurrently. If aBoardOnly is true no
+    // document is created; models, copper and panels are ignored and only
+    // the bare board solid is written
+    PCBMODEL( PCBMODEL* aSystem = NULL, bool aBoardOnly = false );
     virtual ~PCBMODEL();
 
-    // add an outline segment (must be in final position)
-    bool AddOutlineSegment( KICADCURVE* aCurve );
+    // place a board which was created with this model as its system assembly;
+    // aRotation is applied about X, Y then Z (degrees) and then aPosition (mm)
+    bool AddBoard( PCBMODEL* aBoard, const std::string& aName,
+        const TRIPLET& aPosition, const TRIPLET& aRotation );
+
+    // add an outline segment (must be in final position); if aStage is
+    // not NULL the segment is validated and placed in the staging area
+    bool AddOutlineSegment( KICADCURVE* aCurve, PCB_STAGE* aStage = NULL );
 
-    // add a pad hole or slot (must be in final position)
-    bool AddPadHole( KICADPAD* aPad );
+    // add a pad hole or slot (must be in final position); if aStage is
+    // not NULL the cutout is placed in the staging area. Holes of the
+    // same size share one profile which is placed by a location
+    bool AddPadHole( KICADPAD* aPad, PCB_STAGE* aStage = NULL );
 
-    // add a component at the given position and orientation
+    // add the round hole of a via (must be in final position); vias share
+    // the hole primitives of the pad holes so that many thousands of vias
+    // are cut in the same single boolean operation as the pad holes
+    bool AddViaHole( const DOUBLET& aPosition, double aDrill, PCB_STAGE* aStage = NULL );
+
+    // add the copper of a pad (must be in final position) on each outer
+    // layer of the pad; rect, circle, oval and roundrect pads are supported.
+    // If aStage is not NULL the pad is placed in the staging area
+    bool AddPadCopper( KICADPAD* aPad, PCB_STAGE* aStage = NULL );
+
+    // add a copper region (must be in final position) to the top or the
+    // bottom of the board; the regions are extruded by BuildCopper() or,
+    // failing that, by CreatePCB()
+    bool AddCopper( const POLYGON_REGION& aRegion, bool aBottom );
+
+    // extrude the copper regions added so far and release their points;
+    // large sets of regions may be added and extruded in blocks
+    void BuildCopper();
+
+    // add a component at the given position and orientation; if aStage is
+    // not NULL only the placement is computed and the model is loaded when
+    // the stage is committed
     bool AddComponent( const std::string& aFileName, const std::string aRefDes,
         bool aBottom, DOUBLET aPosition, double aRotation,
-        TRIPLET aOffset, TRIPLET aOrientation );
+        TRIPLET aOffset, TRIPLET aOrientation, PCB_STAGE* aStage = NULL );
+
+    // add the contents of a staging area to the model; the staging functions
+    // above only read the PCBMODEL (apart from the locked hole primitives) so
+    // that several stages may be filled concurrently, but stages must be
+    // committed from a single thread
+    bool CommitStage( PCB_STAGE& aStage );
 
     // set the thickness of the PCB (mm); the top of the PCB shall be at Z = aThickness
     // aThickness < 0.0 == use default thickness
@@ -124,9 +418,56 @@ public:
     // aThickness > THICKNESS_MIN == use aThickness
     void SetPCBThickness( double aThickness );
 
+    // limit the board to the given area; only cutouts which intersect
+    // the area are subtracted from the board
+    void SetRegion( const BOX2D& aRegion );
+
+    // reuse the board solid stored in aFileName by a previous run if the
+    // outline, cutouts, thickness and region are unchanged; otherwise the
+    // board is rebuilt and stored for the next run
+    void SetBoardCache( const std::string& aFileName );
+
+    // read models through aCache (NULL = read each model file directly);
+    // the cache must outlive the PCBMODEL
+    void SetModelCache( MODEL_CACHE* aCache );
+
+    // set the number of threads used by the boolean operations (0 = all hardware threads)
+    void SetThreadCount( unsigned aThreads );
+
+    // size the thread pool shared by the parallel boolean operations of all
+    // boards (0 = all hardware threads); call once from the main thread
+    // before any board is built
+    static void InitThreadPool( unsigned aThreads );
+
+    // subtract the cutouts from square tiles of the board of side aSize (mm)
+    // concurrently; aSize <= 0 subtracts all cutouts from the whole board
+    void SetTileSize( double aSize );
+
+    // replace runs of outline segments by fewer lines and arcs which remain
+    // within aTolerance (mm) of the original vertices; 0 = no simplification
+    void SetSimplifyTolerance( double aTolerance );
+
+    // export a panel of aColumns x aRows copies of the board assembly whose
+    // origins are aPitch apart in the model's coordinates (mm); a pitch of 0
+    // leaves PANEL_GAP between the boards. Rails of width aRail run along the
+    // bottom and top of the panel and tabs of width aTab join the boards to
+    // each other and to the rails (0 = none). The board, copper and models
+    // are built once and each copy is placed by a location
+    void SetPanel( int aColumns, int aRows, const DOUBLET& aPitch, double aRail, double aTab );
+
+    // accumulate the time spent on the board construction phases in aProfiler
+    // (NULL = no timing); the profiler must outlive the PCBMODEL
+    void SetProfiler( PROFILER* aProfiler );
+
     // create the PCB model using the current outlines and drill holes
     bool CreatePCB();
 
+    // validate the board solid and each solid of the transferred models
+    // concurrently; invalid shapes are reported with the model file and
+    // the RefDes of the components which use it. Returns false if any
+    // shape is invalid
+    bool CheckShapes();
+
 #ifdef SUPPORTS_IGES
     // write the assembly model in IGES format
     bool WriteIGES( const std::string& aFileName, bool aOverwrite );
@@ -0,0 +1,133 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+/**
+ * @file parallel.h
+ * provides a minimal worker pool for running independent work
+ * items concurrently.
+ */
+
+#ifndef KICAD2MCAD_PARALLEL_H
+#define KICAD2MCAD_PARALLEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Function GetThreadCount
+ * returns the number of worker threads to use for a request of
+ * aRequested threads; 0 selects the number of hardware threads.
+ */
+inline unsigned GetThreadCount( unsigned aRequested )
+{
+    if( aRequested > 0 )
+        return aRequested;
+
+    unsigned nt = std::thread::hardware_concurrency();
+
+    if( nt < 1 )
+        nt = 1;
+
+    return nt;
+}
+
+
+/**
+ * Function ParallelFor
+ * invokes aFunc( i ) for every i in [0, aCount) using up to aThreads
+ * worker threads (0 = hardware threads). Items are handed out in order
+ * but may complete in any order; the caller is responsible for gathering
+ * per-item results. The first exception thrown by a work item is
+ * re-thrown in the calling thread once all workers have stopped.
+ */
+template< typename FUNC >
+void ParallelFor( size_t aCount, unsigned aThreads, FUNC aFunc )
+{
+    if( 0 == aCount )
+        return;
+
+    unsigned nt = GetThreadCount( aThreads );
+
+    if( nt > aCount )
+        nt = (unsigned) aCount;
+
+    if( nt < 2 )
+    {
+        for( size_t i = 0; i < aCount; ++i )
+            aFunc( i );
+
+        return;
+    }
+
+    std::atomic< size_t > next( 0 );
+    std::atomic< bool >   failed( false );
+    std::exception_ptr    error;
+    std::mutex            errlock;
+
+    auto worker = [&]()
+    {
+        while( !failed )
+        {
+            size_t idx = next++;
+
+            if( idx >= aCount )
+                break;
+
+            try
+            {
+                aFunc( idx );
+            }
+            catch( ... )
+            {
+                std::lock_guard< std::mutex > lock( errlock );
+
+                if( !error )
+                    error = std::current_exception();
+
+                failed = true;
+            }
+        }
+    };
+
+    std::vector< std::thread > pool;
+    pool.reserve( nt - 1 );
+
+    for( unsigned i = 1; i < nt; ++i )
+        pool.push_back( std::thread( worker ) );
+
+    // the calling thread takes part in the work
+    worker();
+
+    for( auto& i : pool )
+        i.join();
+
+    if( error )
+        std::rethrow_exception( error );
+}
+
+#endif  // KICAD2MCAD_PARALLEL_H
@@ -0,0 +1,294 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+#include <cstring>
+#include <vector>
+#include "pcbcache.h"
+
+// upper bound on cached strings; a larger length indicates a corrupt file
+#define MAX_STRING_LEN ( 65536 )
+
+
+bool HashFile( const std::string& aFileName, uint64_t& aHash )
+{
+    std::ifstream ifile( aFileName.c_str(), std::ios::in | std::ios::binary );
+
+    if( !ifile.is_open() )
+        return false;
+
+    std::vector< char > buf( 1 << 20 );
+    uint64_t hash = HASH_SEED;
+
+    while( ifile )
+    {
+        ifile.read( &buf[0], buf.size() );
+        std::streamsize nr = ifile.gcount();
+
+        if( nr > 0 )
+            hash = HashBytes( &buf[0], (size_t) nr, hash );
+    }
+
+    if( !ifile.eof() )
+        return false;
+
+    aHash = hash;
+    return true;
+}
+
+
+CACHE_WRITER::CACHE_WRITER()
+{
+    return;
+}
+
+
+CACHE_WRITER::~CACHE_WRITER()
+{
+    if( m_file.is_open() )
+        m_file.close();
+
+    return;
+}
+
+
+bool CACHE_WRITER::Open( const std::string& aFileName )
+{
+    m_file.open( aFileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+    return m_file.is_open();
+}
+
+
+bool CACHE_WRITER::Close()
+{
+    if( !m_file.is_open() )
+        return false;
+
+    m_file.flush();
+    bool ok = m_file.good();
+    m_file.close();
+
+    return ok;
+}
+
+
+void CACHE_WRITER::Put( const void* aData, size_t aSize )
+{
+    m_file.write( (const char*) aData, aSize );
+    return;
+}
+
+
+void CACHE_WRITER::PutInt( int64_t aValue )
+{
+    Put( &aValue, sizeof( aValue ) );
+    return;
+}
+
+
+void CACHE_WRITER::PutDouble( double aValue )
+{
+    Put( &aValue, sizeof( aValue ) );
+    return;
+}
+
+
+void CACHE_WRITER::PutBool( bool aValue )
+{
+    char val = aValue ? 1 : 0;
+    Put( &val, 1 );
+    return;
+}
+
+
+void CACHE_WRITER::PutString( const std::string& aValue )
+{
+    PutInt( (int64_t) aValue.size() );
+    Put( aValue.data(), aValue.size() );
+    return;
+}
+
+
+void CACHE_WRITER::PutDoublet( const DOUBLET& aValue )
+{
+    PutDouble( aValue.x );
+    PutDouble( aValue.y );
+    return;
+}
+
+
+void CACHE_WRITER::PutTriplet( const TRIPLET& aValue )
+{
+    PutDouble( aValue.x );
+    PutDouble( aValue.y );
+    PutDouble( aValue.z );
+    return;
+}
+
+
+void CACHE_WRITER::PutPoint( const NMPOINT& aValue )
+{
+    PutInt( aValue.x );
+    PutInt( aValue.y );
+    return;
+}
+
+
+void CACHE_WRITER::PutBox( const BOX2D& aValue )
+{
+    PutDouble( aValue.minx );
+    PutDouble( aValue.miny );
+    PutDouble( aValue.maxx );
+    PutDouble( aValue.maxy );
+    return;
+}
+
+
+CACHE_READER::CACHE_READER()
+{
+    m_ok = false;
+    return;
+}
+
+
+CACHE_READER::~CACHE_READER()
+{
+    Close();
+    return;
+}
+
+
+bool CACHE_READER::Open( const std::string& aFileName )
+{
+    m_file.open( aFileName.c_str(), std::ios::in | std::ios::binary );
+    m_ok = m_file.is_open();
+    return m_ok;
+}
+
+
+void CACHE_READER::Close()
+{
+    if( m_file.is_open() )
+        m_file.close();
+
+    return;
+}
+
+
+bool CACHE_READER::Get( void* aData, size_t aSize )
+{
+    if( !m_ok )
+        return false;
+
+    m_file.read( (char*) aData, aSize );
+
+    if( m_file.gcount() != (std::streamsize) aSize )
+    {
+        memset( aData, 0, aSize );
+        m_ok = false;
+    }
+
+    return m_ok;
+}
+
+
+int64_t CACHE_READER::GetInt()
+{
+    int64_t val = 0;
+    Get( &val, sizeof( val ) );
+    return val;
+}
+
+
+double CACHE_READER::GetDouble()
+{
+    double val = 0.0;
+    Get( &val, sizeof( val ) );
+    return val;
+}
+
+
+bool CACHE_READER::GetBool()
+{
+    char val = 0;
+    Get( &val, 1 );
+    return val ? true : false;
+}
+
+
+std::string CACHE_READER::GetString()
+{
+    int64_t len = GetInt();
+
+    if( len < 0 || len > MAX_STRING_LEN )
+    {
+        m_ok = false;
+        return std::string();
+    }
+
+    std::string val( (size_t) len, '\0' );
+
+    if( len > 0 )
+        Get( &val[0], (size_t) len );
+
+    return val;
+}
+
+
+DOUBLET CACHE_READER::GetDoublet()
+{
+    DOUBLET val;
+    val.x = GetDouble();
+    val.y = GetDouble();
+    return val;
+}
+
+
+TRIPLET CACHE_READER::GetTriplet()
+{
+    TRIPLET val;
+    val.x = GetDouble();
+    val.y = GetDouble();
+    val.z = GetDouble();
+    return val;
+}
+
+
+NMPOINT CACHE_READER::GetPoint()
+{
+    NMPOINT val;
+    val.x = GetInt();
+    val.y = GetInt();
+    return val;
+}
+
+
+BOX2D CACHE_READER::GetBox()
+{
+    BOX2D val;
+    val.minx = GetDouble();
+    val.miny = GetDouble();
+    val.maxx = GetDouble();
+    val.maxy = GetDouble();
+    return val;
+}
@@ -0,0 +1,117 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+/**
+ * @file pcbcache.h
+ * declares the binary stream objects used to cache the data extracted
+ * from a PCB file.
+ */
+
+#ifndef PCBCACHE_H
+#define PCBCACHE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "base.h"
+
+// identifies a board cache file; CACHE_VERSION must be incremented
+// whenever the layout of the cached data changes
+#define CACHE_MAGIC         ( 0x434d324bLL )           // "K2MC"
+#define CACHE_VERSION       ( 7 )
+// the cache is only valid on machines with the byte order of the writer
+#define CACHE_BYTE_ORDER    ( 0x0102030405060708LL )
+
+
+/**
+ * Function HashFile
+ * computes the 64-bit FNV-1a hash of the contents of a file;
+ * returns false if the file cannot be read.
+ */
+bool HashFile( const std::string& aFileName, uint64_t& aHash );
+
+
+class CACHE_WRITER
+{
+private:
+    std::ofstream m_file;
+
+public:
+    CACHE_WRITER();
+    virtual ~CACHE_WRITER();
+
+    bool Open( const std::string& aFileName );
+    // close the file; returns false if any write failed
+    bool Close();
+
+    void Put( const void* aData, size_t aSize );
+    void PutInt( int64_t aValue );
+    void PutDouble( double aValue );
+    void PutBool( bool aValue );
+    void PutString( const std::string& aValue );
+    void PutDoublet( const DOUBLET& aValue );
+    void PutTriplet( const TRIPLET& aValue );
+    void PutPoint( const NMPOINT& aValue );
+    void PutBox( const BOX2D& aValue );
+};
+
+
+class CACHE_READER
+{
+private:
+    std::ifstream m_file;
+    bool          m_ok;     // cleared on the first failed read
+
+public:
+    CACHE_READER();
+    virtual ~CACHE_READER();
+
+    bool Open( const std::string& aFileName );
+    void Close();
+
+    // returns false if any read has failed
+    bool IsOK() const
+    {
+        return m_ok;
+    }
+
+    // mark the cache as unusable; invoked when a record fails validation
+    // since the following data can no longer be trusted to be aligned
+    void Invalidate()
+    {
+        m_ok = false;
+    }
+
+    bool Get( void* aData, size_t aSize );
+    int64_t GetInt();
+    double GetDouble();
+    bool GetBool();
+    std::string GetString();
+    DOUBLET GetDoublet();
+    TRIPLET GetTriplet();
+    NMPOINT GetPoint();
+    BOX2D GetBox();
+};
+
+#endif  // PCBCACHE_H
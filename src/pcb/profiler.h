@@ -0,0 +1,123 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+
+/**
+ * @file profiler.h
+ * provides a simple accumulator of the wall-clock time spent in
+ * the processing phases of an export.
+ */
+
+#ifndef KICAD2MCAD_PROFILER_H
+#define KICAD2MCAD_PROFILER_H
+
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+class PROFILER
+{
+private:
+    std::vector< std::pair< std::string, double > > m_phases;  // phase name, seconds
+    std::mutex m_lock;
+
+public:
+    // add aSeconds to the named phase; phases are reported in the order of first use
+    void Add( const std::string& aPhase, double aSeconds )
+    {
+        std::lock_guard< std::mutex > lock( m_lock );
+
+        for( auto& i : m_phases )
+        {
+            if( i.first == aPhase )
+            {
+                i.second += aSeconds;
+                return;
+            }
+        }
+
+        m_phases.push_back( std::make_pair( aPhase, aSeconds ) );
+    }
+
+    void Clear()
+    {
+        std::lock_guard< std::mutex > lock( m_lock );
+        m_phases.clear();
+    }
+
+    std::string Report()
+    {
+        std::lock_guard< std::mutex > lock( m_lock );
+        std::ostringstream ostr;
+        double total = 0.0;
+
+        ostr << "* profile:\n";
+
+        for( auto& i : m_phases )
+        {
+            ostr << "    " << std::left << std::setw( 24 ) << i.first << std::right;
+            ostr << std::fixed << std::setprecision( 3 ) << std::setw( 10 ) << i.second << " s\n";
+            total += i.second;
+        }
+
+        ostr << "    " << std::left << std::setw( 24 ) << "total" << std::right;
+        ostr << std::fixed << std::setprecision( 3 ) << std::setw( 10 ) << total << " s\n";
+
+        return ostr.str();
+    }
+};
+
+
+// times the enclosing scope and adds the time to a phase of
+// the profiler; no timing is done if the profiler is NULL
+class PROFILE_SCOPE
+{
+private:
+    PROFILER*   m_profiler;
+    const char* m_phase;
+    std::chrono::steady_clock::time_point m_start;
+
+public:
+    PROFILE_SCOPE( PROFILER* aProfiler, const char* aPhase ) :
+        m_profiler( aProfiler ), m_phase( aPhase )
+    {
+        if( m_profiler )
+            m_start = std::chrono::steady_clock::now();
+    }
+
+    ~PROFILE_SCOPE()
+    {
+        if( m_profiler )
+        {
+            std::chrono::duration< double > dt = std::chrono::steady_clock::now() - m_start;
+            m_profiler->Add( m_phase, dt.count() );
+        }
+    }
+};
+
+#endif  // KICAD2MCAD_PROFILER_H
@@ -0,0 +1,197 @@
+/*
+ * This program source code file is part of kicad2mcad
+ *
+ * Copyright (C) 2016 Cirilo Bernardo <cirilo.bernardo@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you may find one here:
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * or you may search the http://www.gnu.org website for the version 2 license,
+ * or you may write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+/**
+ * @file rtree.h
+ * provides a static 2D R-tree. Items are collected with Insert() and
+ * the tree is packed in one pass using the Sort-Tile-Recursive method
+ * when Build() is invoked; the tree is then used for window queries.
+ */
+
+#ifndef KICAD2MCAD_RTREE_H
+#define KICAD2MCAD_RTREE_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "base.h"
+
+
+template< typename T >
+class RTREE
+{
+private:
+    enum { NODE_SIZE = 16 };    // maximum number of children per node
+
+    struct ENTRY
+    {
+        BOX2D   box;
+        T       item;
+    };
+
+    struct NODE
+    {
+        BOX2D   box;
+        size_t  first;  // index of the first child (entry for leaves, node otherwise)
+        size_t  count;  // number of children
+        bool    leaf;
+    };
+
+    std::vector< ENTRY >    m_entries;
+    std::vector< NODE >     m_nodes;
+    bool                    m_built;
+
+    // order items into vertical slices by X, then by Y within each slice,
+    // so that consecutive runs of NODE_SIZE items are spatially compact
+    template< typename U, typename BOXFN >
+    static void strSort( std::vector< U >& aItems, BOXFN aBox )
+    {
+        size_t nItems = aItems.size();
+        size_t nGroups = ( nItems + NODE_SIZE - 1 ) / NODE_SIZE;
+        size_t nSlices = (size_t) std::ceil( std::sqrt( (double) nGroups ) );
+        size_t sliceSize = nSlices * NODE_SIZE;
+
+        std::sort( aItems.begin(), aItems.end(), [&]( const U& a, const U& b )
+            {
+                return aBox( a ).minx + aBox( a ).maxx < aBox( b ).minx + aBox( b ).maxx;
+            } );
+
+        for( size_t i = 0; i < nItems; i += sliceSize )
+        {
+            size_t last = std::min( i + sliceSize, nItems );
+
+            std::sort( aItems.begin() + i, aItems.begin() + last, [&]( const U& a, const U& b )
+                {
+                    return aBox( a ).miny + aBox( a ).maxy < aBox( b ).miny + aBox( b ).maxy;
+                } );
+        }
+    }
+
+public:
+    RTREE() : m_built( false ) { return; }
+
+    void Clear()
+    {
+        m_entries.clear();
+        m_nodes.clear();
+        m_built = false;
+    }
+
+    size_t Size() const
+    {
+        return m_entries.size();
+    }
+
+    void Insert( const BOX2D& aBox, const T& aItem )
+    {
+        ENTRY entry;
+        entry.box = aBox;
+        entry.item = aItem;
+        m_entries.push_back( entry );
+        m_built = false;
+    }
+
+    // pack the tree; must be invoked after the last Insert() and before Query()
+    void Build()
+    {
+        m_nodes.clear();
+        m_built = true;
+
+        if( m_entries.empty() )
+            return;
+
+        strSort( m_entries, []( const ENTRY& e ) -> const BOX2D& { return e.box; } );
+
+        std::vector< NODE > level;
+
+        for( size_t i = 0; i < m_entries.size(); i += NODE_SIZE )
+        {
+            NODE node;
+            node.first = i;
+            node.count = std::min( (size_t) NODE_SIZE, m_entries.size() - i );
+            node.leaf = true;
+
+            for( size_t j = 0; j < node.count; ++j )
+                node.box.Add( m_entries[i + j].box );
+
+            level.push_back( node );
+        }
+
+        while( level.size() > 1 )
+        {
+            strSort( level, []( const NODE& n ) -> const BOX2D& { return n.box; } );
+
+            size_t base = m_nodes.size();
+            m_nodes.insert( m_nodes.end(), level.begin(), level.end() );
+
+            std::vector< NODE > parents;
+
+            for( size_t i = 0; i < level.size(); i += NODE_SIZE )
+            {
+                NODE node;
+                node.first = base + i;
+                node.count = std::min( (size_t) NODE_SIZE, level.size() - i );
+                node.leaf = false;
+
+                for( size_t j = 0; j < node.count; ++j )
+                    node.box.Add( level[i + j].box );
+
+                parents.push_back( node );
+            }
+
+            level.swap( parents );
+        }
+
+        // the root is always the last node
+        m_nodes.push_back( level.front() );
+    }
+
+    // append all items whose boxes intersect aBox to aResult
+    void Query( const BOX2D& aBox, std::vector< T >& aResult ) const
+    {
+        if( !m_built || m_nodes.empty() )
+            return;
+
+        std::vector< size_t > stack;
+        stack.push_back( m_nodes.size() - 1 );
+
+        while( !stack.empty() )
+        {
+            const NODE& node = m_nodes[stack.back()];
+            stack.pop_back();
+
+            if( !node.box.Intersects( aBox ) )
+                continue;
+
+            for( size_t i = node.first; i < node.first + node.count; ++i )
+            {
+                if( !node.leaf )
+                    stack.push_back( i );
+                else if( m_entries[i].box.Intersects( aBox ) )
+                    aResult.push_back( m_entries[i].item );
+            }
+        }
+    }
+};
+
+#endif  // KICAD2MCAD_RTREE_H
@@ -120,6 +120,24 @@ namespace SEXPR
         }
     }
 
+    int64_t SEXPR::GetMillionths() const
+    {
+        // the fixed point value of a number in units of 10^-6; for KiCad
+        // board data (mm) this is the value in nanometers
+        if (m_type == SEXPR_TYPE_ATOM_DOUBLE )
+        {
+            return static_cast<SEXPR_DOUBLE const *>(this)->m_millionths;
+        }
+        else if( m_type == SEXPR_TYPE_ATOM_INTEGER )
+        {
+            return static_cast<SEXPR_INTEGER const *>(this)->m_value * 1000000;
+        }
+        else
+        {
+            throw INVALID_TYPE_EXCEPTION("SEXPR is not a numeric type!");
+        }
+    }
+
     float SEXPR::GetFloat() const
     {
         return static_cast<float>(GetDouble());
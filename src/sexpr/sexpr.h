@@ -19,6 +19,7 @@
 #ifndef SEXPR_H_
 #define SEXPR_H_
 
+#include <cmath>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -65,6 +66,7 @@ namespace SEXPR
 		int32_t GetInteger() const;
 		float GetFloat() const;
 		double GetDouble() const;
+		int64_t GetMillionths() const;
 		std::string const & GetString() const;
 		std::string const & GetSymbol() const;
 		SEXPR_LIST* GetList();
@@ -82,8 +84,13 @@ namespace SEXPR
 	struct SEXPR_DOUBLE : public SEXPR
 	{
 		double m_value;
-		SEXPR_DOUBLE(double value) : SEXPR(SEXPR_TYPE_ATOM_DOUBLE), m_value(value) {};
-		SEXPR_DOUBLE(double value, int lineNumber) : SEXPR(SEXPR_TYPE_ATOM_DOUBLE, lineNumber), m_value(value) {};
+		int64_t m_millionths;	// value * 10^6; exact when parsed from decimal text
+		SEXPR_DOUBLE(double value) : SEXPR(SEXPR_TYPE_ATOM_DOUBLE), m_value(value),
+			m_millionths(static_cast<int64_t>(std::llround(value * 1e6))) {};
+		SEXPR_DOUBLE(double value, int lineNumber) : SEXPR(SEXPR_TYPE_ATOM_DOUBLE, lineNumber), m_value(value),
+			m_millionths(static_cast<int64_t>(std::llround(value * 1e6))) {};
+		SEXPR_DOUBLE(double value, int64_t millionths, int lineNumber) : SEXPR(SEXPR_TYPE_ATOM_DOUBLE, lineNumber),
+			m_value(value), m_millionths(millionths) {};
 	};
 
 	struct SEXPR_STRING : public SEXPR
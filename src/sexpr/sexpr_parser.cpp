@@ -30,6 +30,52 @@ namespace SEXPR
 {
     const std::string PARSER::whitespaceCharacters = " \t\n\r\b\f\v";
 
+    // convert a decimal token to an integer number of millionths directly
+    // from the text so that no binary floating point rounding is involved;
+    // digits beyond the sixth decimal place are rounded
+    static int64_t parseMillionths(const std::string& aText)
+    {
+        size_t idx = 0;
+        bool negative = false;
+
+        if (idx < aText.size() && aText[idx] == '-')
+        {
+            negative = true;
+            ++idx;
+        }
+
+        int64_t value = 0;
+
+        for (; idx < aText.size() && isdigit(aText[idx]); ++idx)
+            value = value * 10 + (aText[idx] - '0');
+
+        int ndigits = 0;
+        bool roundUp = false;
+
+        if (idx < aText.size() && aText[idx] == '.')
+        {
+            for (++idx; idx < aText.size() && isdigit(aText[idx]); ++idx)
+            {
+                if (ndigits < 6)
+                    value = value * 10 + (aText[idx] - '0');
+                else if (ndigits == 6)
+                    roundUp = aText[idx] >= '5';
+                else
+                    break;
+
+                ++ndigits;
+            }
+        }
+
+        for (; ndigits < 6; ++ndigits)
+            value *= 10;
+
+        if (roundUp)
+            ++value;
+
+        return negative ? -value : value;
+    }
+
     PARSER::PARSER() : m_lineNumber(0), m_lineOffset(0)
     {
     }
@@ -150,7 +196,8 @@ namespace SEXPR
                         SEXPR* res;
                         if (tmp.find('.') != std::string::npos)
                         {
-                            res = new SEXPR_DOUBLE(strtod(tmp.c_str(), NULL), m_lineNumber);
+                            res = new SEXPR_DOUBLE(strtod(tmp.c_str(), NULL),
+                                parseMillionths(tmp), m_lineNumber);
                             //floating point type
                         }
                         else